@@ -8,14 +8,29 @@ int main(int argc, char* argv[]){
     std::string file;
     int q = 0;
     int n = 0;
+    // Binary dataset (.mcmb) instead of text (.dat)
+    bool binary = false;
+    bool convert = false;
     // Gauge transformation
     bool gt = false;
 
     // Search method
     bool log_file = false;
     bool exhaustive = false;
+    bool subset_dp = false;
+    bool branch_bound = false;
     bool greedy = false;
+    bool batch_greedy = false;
     bool div_and_conq = false;
+    // Distribution of the log evidence in the exhaustive search
+    double histogram_width = 0;
+    int top_k = 0;
+    // Checkpoints of the exhaustive search
+    double checkpoint_interval = 0;
+    bool resume = false;
+    // Part of the partitions processed by the exhaustive search (shard i of k)
+    int shard = 0;
+    int n_shards = 0;
 
     // Process user input
     std::string arg;
@@ -34,6 +49,49 @@ int main(int argc, char* argv[]){
         if (arg == "-q"){
             q = std::stoi(argv[i+1]);
         }
+        // Read the binary version of the dataset
+        if (arg == "-b"){
+            binary = true;
+        }
+        // Only convert the dataset to the binary format
+        if (arg == "-convert"){
+            convert = true;
+        }
+        // Number of threads
+        if (arg == "-threads"){
+            set_num_threads(std::stoi(argv[i+1]));
+        }
+        // Histogram of the log evidence of all partitions in the exhaustive search
+        if (arg == "-hist"){
+            histogram_width = std::stod(argv[i+1]);
+        }
+        // Number of best partitions that are kept in the exhaustive search
+        if (arg == "-topk"){
+            top_k = std::stoi(argv[i+1]);
+        }
+        // Write the progress of the exhaustive search to a checkpoint file every given number of seconds
+        if (arg == "-checkpoint"){
+            checkpoint_interval = std::stod(argv[i+1]);
+        }
+        // Only process shard i (0 to k-1) of k parts of the partitions in the exhaustive search
+        if (arg == "-shard"){
+            std::string shard_arg = argv[i+1];
+            size_t slash = shard_arg.find('/');
+            if (slash == std::string::npos){
+                std::cout << "Argument for the shard should be of the form i/k." << std::endl;
+                return 0;
+            }
+            shard = std::stoi(shard_arg.substr(0, slash));
+            n_shards = std::stoi(shard_arg.substr(slash + 1));
+            if (n_shards < 1 || shard < 0 || shard >= n_shards){
+                std::cout << "Shard index should be between 0 and k-1." << std::endl;
+                return 0;
+            }
+        }
+        // Continue the exhaustive search from the checkpoint file
+        if (arg == "-resume"){
+            resume = true;
+        }
         // Log files to store the steps in the search process
         if (arg == "-l"){
             log_file = true;
@@ -46,9 +104,18 @@ int main(int argc, char* argv[]){
         if (arg == "-es"){
             exhaustive = true;
         }
+        if (arg == "-dp"){
+            subset_dp = true;
+        }
+        if (arg == "-bb"){
+            branch_bound = true;
+        }
         if (arg == "-gs"){
             greedy = true;
         }
+        if (arg == "-gb"){
+            batch_greedy = true;
+        }
         if (arg == "-dc"){
             div_and_conq = true;
         }
@@ -66,22 +133,48 @@ int main(int argc, char* argv[]){
         std::cout << "Too many variables. Maximum system size is 128." << std::endl;
         return 0;
     }
+    // The binary file is memory-mapped while it is read -> it cannot be rewritten from itself
+    if (convert && binary){
+        std::cout << "The options -convert and -b cannot be combined." << std::endl;
+        return 0;
+    }
 
     // File should be located in the input folder
     std::string path = "../input/" + file + ".dat";
+    std::string binary_path = "../input/" + file + ".mcmb";
 
     // Construct mcm model
     mcm model = create_model(q, n, log_file);
     // Read in data
-    std::vector<std::vector<__uint128_t>> data;
-    data = data_processing(path, n, model.n_ints);
-    if(data.size() == 0){return 1;}
-    // Add the data to the model
-    model.data = data;
-    model.N = data.size();
+    if (binary){
+        // Memory-mapped binary dataset that is already processed
+        if (!read_binary(binary_path, model)){return 1;}
+    }
+    else{
+        dataset data = data_processing(path, n, model.n_ints, q);
+        if(data.n_states == 0){return 1;}
+        // Add the data to the model (every different state is stored once with its multiplicity)
+        if (!load_data(model, data)){return 1;}
+    }
+
+    // Converter mode: write the processed dataset in the binary format and stop
+    if (convert){
+        if (!write_binary(binary_path, model)){return 1;}
+        std::cout << "Binary dataset written to " << binary_path << std::endl;
+        return 0;
+    }
+    // Bit-sliced view of the data for the popcount kernels (q = 2)
+    if (q == 2){
+        build_bit_slices(model.data, n);
+    }
 
     // Create output file in the output folder
-    std::ofstream outputFile("../output/" + file + "_output.dat");
+    // Every shard has its own output file
+    std::string output_name = file;
+    if (n_shards > 1){
+        output_name += "_shard_" + std::to_string(shard) + "_of_" + std::to_string(n_shards);
+    }
+    std::ofstream outputFile("../output/" + output_name + "_output.dat");
 
     // Gauge transformation
     if (gt){
@@ -125,6 +218,23 @@ int main(int argc, char* argv[]){
 
     // Exhaustive search
     if (exhaustive){
+        model.histogram.width = histogram_width;
+        model.top_mcm.k = top_k;
+        model.shard = shard;
+        model.n_shards = n_shards;
+        if (checkpoint_interval > 0 || resume || n_shards > 1){
+            // The results of a shard are always written to its checkpoint file, which is used to merge the shards
+            if (n_shards > 1){
+                model.checkpoint_file = "../output/" + output_name + ".mcmc";
+            }
+            else{
+                model.checkpoint_file = "../output/" + file + "_checkpoint.mcmc";
+            }
+            if (checkpoint_interval > 0){
+                model.checkpoint_interval = checkpoint_interval;
+            }
+            model.resume = resume;
+        }
         auto start = std::chrono::high_resolution_clock::now();
         exhaustive_search(model);
         auto stop = std::chrono::high_resolution_clock::now();
@@ -134,11 +244,76 @@ int main(int argc, char* argv[]){
         outputFile << "# Exhaustive search # " << '\n';
         outputFile << "##################### \n\n";
 
+        if (n_shards > 1){
+            outputFile << "Shard " << shard << " of " << n_shards << " (use mcm_merge to combine the shards)" << "\n\n";
+        }
+
         outputFile << "Duration: " << duration.count() / 1000 << "s \n" << '\n';
         outputFile << "Number of equivalent best MCMs found : " << model.best_mcm.size() << "\n\n";
         outputFile << "Best MCM(s): " << std::endl;
         outputFile << "\n";
-        for (int i = 0; i < model.best_mcm.size(); ++i){
+        for (size_t i = 0; i < model.best_mcm.size(); ++i){
+            print_partition_to_file(outputFile, model.best_mcm[i]);
+            outputFile << "\n";
+        }
+        outputFile << "Best log-evidence: " << model.best_evidence << "\n" << '\n';
+
+        // Distribution of the log evidence of all partitions
+        if (histogram_width > 0){
+            outputFile << "Histogram of the log-evidence (bin width " << histogram_width << "):" << "\n\n";
+            for (int64_t i = 0; i < (int64_t) model.histogram.counts.size(); ++i){
+                if (model.histogram.counts[i] == 0){continue;}
+                outputFile << (model.histogram.first_bin + i) * histogram_width << " : " << model.histogram.counts[i] << '\n';
+            }
+            outputFile << '\n';
+        }
+        if (top_k > 0){
+            outputFile << "Top " << top_k << " MCMs:" << "\n\n";
+            for (std::pair<double, std::vector<__uint128_t>>& entry : sorted_top(model.top_mcm)){
+                print_partition_to_file(outputFile, entry.second);
+                outputFile << "Log-evidence: " << entry.first << "\n\n";
+            }
+        }
+    }
+
+    // Exact search with dynamic programming over subsets
+    if (subset_dp){
+        auto start = std::chrono::high_resolution_clock::now();
+        subset_dp_search(model);
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+
+        outputFile << "############################## \n";
+        outputFile << "# Dynamic programming search # " << '\n';
+        outputFile << "############################## \n\n";
+
+        outputFile << "Duration: " << duration.count() / 1000 << "s \n" << '\n';
+        outputFile << "Number of equivalent best MCMs found : " << model.best_mcm.size() << "\n\n";
+        outputFile << "Best MCM(s): " << std::endl;
+        outputFile << "\n";
+        for (size_t i = 0; i < model.best_mcm.size(); ++i){
+            print_partition_to_file(outputFile, model.best_mcm[i]);
+            outputFile << "\n";
+        }
+        outputFile << "Best log-evidence: " << model.best_evidence << "\n" << '\n';
+    }
+
+    // Exact search with branch and bound
+    if (branch_bound){
+        auto start = std::chrono::high_resolution_clock::now();
+        branch_and_bound_search(model);
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+
+        outputFile << "########################### \n";
+        outputFile << "# Branch and bound search # " << '\n';
+        outputFile << "########################### \n\n";
+
+        outputFile << "Duration: " << duration.count() / 1000 << "s \n" << '\n';
+        outputFile << "Number of equivalent best MCMs found : " << model.best_mcm.size() << "\n\n";
+        outputFile << "Best MCM(s): " << std::endl;
+        outputFile << "\n";
+        for (size_t i = 0; i < model.best_mcm.size(); ++i){
             print_partition_to_file(outputFile, model.best_mcm[i]);
             outputFile << "\n";
         }
@@ -173,6 +348,34 @@ int main(int argc, char* argv[]){
         outputFile << "Best log-evidence: " << model.best_evidence << "\n" <<std::endl;
     }
 
+    // Greedy search with several merges per iteration
+    if (batch_greedy){
+        model.best_mcm.clear();
+        if(log_file){
+            model.greedy_file = new std::ofstream("../output/" + file + "_batch_greedy_search.dat");
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        batch_greedy_search(model);
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+
+        if(log_file){
+            model.greedy_file->close();
+        }
+        outputFile << "######################### \n";
+        outputFile << "# Batched greedy search # \n";
+        outputFile << "######################### \n\n";
+
+        outputFile << "Duration: " << duration.count() / 1000 << "s \n" << '\n';    
+
+        outputFile << "Best MCM: " << std::endl;
+        outputFile << "\n";
+        print_partition_to_file(outputFile, model.best_mcm[0]);
+        outputFile << "\n";
+        outputFile << "Best log-evidence: " << model.best_evidence << "\n" <<std::endl;
+    }
+
     // Divide and conquer
     if (div_and_conq){
         model.best_mcm.clear();
@@ -0,0 +1,87 @@
+#include "model/model.h"
+#include "search_algorithms/search.h"
+
+int main(int argc, char* argv[]){
+    if (argc < 3){
+        std::cout << "Usage: mcm_merge merged_file shard_file_1 shard_file_2 ..." << std::endl;
+        std::cout << "Combines the results of the shards of an exhaustive search (files *_shard_i_of_k.mcmc in the output folder)." << std::endl;
+        return 0;
+    }
+    std::string merged_file = argv[1];
+
+    // Read in the first shard
+    checkpoint_header header;
+    search_progress merged;
+    if (!read_checkpoint_file(argv[2], header, merged)){return 1;}
+
+    // Add the other shards
+    for (int i = 3; i < argc; ++i){
+        checkpoint_header shard_header;
+        search_progress shard;
+        if (!read_checkpoint_file(argv[i], shard_header, shard)){return 1;}
+        if (shard_header.n != header.n || shard_header.q != header.q || shard_header.N != header.N || shard_header.checksum != header.checksum){
+            std::cout << "The shard " << argv[i] << " belongs to another dataset." << std::endl;
+            return 1;
+        }
+        if (shard.k != merged.k || shard.done.size() != merged.done.size() || shard.n_shards != merged.n_shards){
+            std::cout << "The shard " << argv[i] << " belongs to a search with other work units." << std::endl;
+            return 1;
+        }
+        if (shard.result.histogram.width != merged.result.histogram.width || shard.result.top_mcm.k != merged.result.top_mcm.k){
+            std::cout << "The shard " << argv[i] << " was run with other options for the histogram or the best partitions." << std::endl;
+            return 1;
+        }
+        for (size_t unit = 0; unit < merged.done.size(); ++unit){
+            if (shard.done[unit] && merged.done[unit]){
+                std::cout << "The shard " << argv[i] << " overlaps with another shard." << std::endl;
+                return 1;
+            }
+            merged.done[unit] |= shard.done[unit];
+        }
+        merge_unit_result(merged.result, shard.result);
+    }
+
+    // The merged file is a checkpoint of the full search -> missing units can be processed with -resume
+    merged.n_shards = 1;
+    header.shard = 0;
+    header.n_shards = 1;
+    if (!write_checkpoint_file(merged_file, header, merged)){return 1;}
+
+    size_t n_done = 0;
+    for (char done : merged.done){
+        n_done += done;
+    }
+    std::cout << "Work units done: " << n_done << " of " << merged.done.size() << "\n\n";
+    if (n_done < merged.done.size()){
+        std::cout << "Not all shards are complete: rename " << merged_file << " to filename_checkpoint.mcmc in the output folder and use -resume to process the remaining units." << std::endl;
+    }
+
+    // Best partitions in the order of the exhaustive search
+    std::vector<std::vector<__uint128_t>> best_mcm = merged.result.best_mcm;
+    std::sort(best_mcm.begin(), best_mcm.end(), comp_rgs);
+    std::cout << "Number of equivalent best MCMs found : " << best_mcm.size() << "\n\n";
+    std::cout << "Best MCM(s): " << "\n\n";
+    for (std::vector<__uint128_t>& partition : best_mcm){
+        print_partition_to_terminal(partition);
+    }
+    std::cout << "Best log-evidence: " << merged.result.best_evidence << "\n" << std::endl;
+
+    // Distribution of the log evidence of all partitions
+    evidence_histogram& histogram = merged.result.histogram;
+    if (histogram.width > 0){
+        std::cout << "Histogram of the log-evidence (bin width " << histogram.width << "):" << "\n\n";
+        for (int64_t i = 0; i < (int64_t) histogram.counts.size(); ++i){
+            if (histogram.counts[i] == 0){continue;}
+            std::cout << (histogram.first_bin + i) * histogram.width << " : " << histogram.counts[i] << '\n';
+        }
+        std::cout << std::endl;
+    }
+    if (merged.result.top_mcm.k > 0){
+        std::cout << "Top " << merged.result.top_mcm.k << " MCMs:" << "\n\n";
+        for (std::pair<double, std::vector<__uint128_t>>& entry : sorted_top(merged.result.top_mcm)){
+            print_partition_to_terminal(entry.second);
+            std::cout << "Log-evidence: " << entry.first << "\n\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "model.h"
+
+/**
+ * Builds the column-major bit-sliced view of a dataset.
+ * 
+ * For every variable and every plane, the bits of all states are packed into a bitset of 64bit words.
+ * The weights of the states are sliced in the same way (one bitset per bit of the weights).
+ * 
+ * @param[in, out] data         View on the dataset.
+ *                              -'slices' will contain the bit-sliced view (the existing view is overwritten).
+ * @param n                     Number of variables in the system.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void build_bit_slices(dataset& data, int n){
+    if (!data.slices){
+        data.slices = std::make_shared<bit_slices>();
+    }
+    bit_slices& slices = *data.slices;
+    slices.n = n;
+    slices.n_ints = data.n_ints;
+    slices.n_words = (data.n_states + 63) / 64;
+
+    // Number of bits necessary to represent the largest weight
+    unsigned int max_weight = 0;
+    for (int i = 0; i < data.n_states; ++i){
+        max_weight = std::max(max_weight, data.weights[i]);
+    }
+    slices.n_weight_planes = 0;
+    while (max_weight >> slices.n_weight_planes){
+        ++slices.n_weight_planes;
+    }
+
+    slices.columns.assign((size_t) n * data.n_ints * slices.n_words, 0);
+    slices.weight_planes.assign((size_t) slices.n_weight_planes * slices.n_words, 0);
+    parallel_for(slices.n_words, [&](int w){
+        // Every task fills one word of all columns
+        for (int i = 64 * w; i < std::min(64 * w + 64, data.n_states); ++i){
+            uint64_t bit = (uint64_t) 1 << (i % 64);
+            const __uint128_t* state = data.states + (size_t) i * data.n_ints;
+            for (int k = 0; k < data.n_ints; ++k){
+                __uint128_t plane = state[k];
+                while (plane){
+                    // Index of the least significant bit set to 1
+                    uint64_t low = (uint64_t) plane;
+                    int j = low ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t) (plane >> 64));
+                    slices.columns[((size_t) j * data.n_ints + k) * slices.n_words + w] |= bit;
+                    plane &= plane - 1;
+                }
+            }
+            unsigned int weight = data.weights[i];
+            for (int b = 0; weight; ++b, weight >>= 1){
+                if (weight & 1){
+                    slices.weight_planes[(size_t) b * slices.n_words + w] |= bit;
+                }
+            }
+        }
+    });
+}
+
+/**
+ * Returns the bitset of a variable in a given plane of the bit-sliced view.
+ * 
+ * @param[in] slices            Bit-sliced view on the dataset.
+ * @param variable              Index of the variable.
+ * @param plane                 Index of the plane (0 to n_ints-1).
+ * 
+ * @return Pointer to the first of the n_words 64bit words of the bitset.
+ */
+const uint64_t* get_column(const bit_slices& slices, int variable, int plane){
+    return &slices.columns[((size_t) variable * slices.n_ints + plane) * slices.n_words];
+}
+
+/**
+ * Sums the weights of the states selected by a mask in one word of the bit-sliced view.
+ * 
+ * @param[in] slices            Bit-sliced view on the dataset.
+ * @param mask                  Bits set to 1 for the selected states in word w.
+ * @param w                     Index of the word.
+ * 
+ * @return The sum of the weights of the selected states.
+ */
+uint64_t weighted_popcount(const bit_slices& slices, uint64_t mask, int w){
+    // sum_i w_i = sum_b 2^b * (number of selected states with bit b of their weight set to 1)
+    uint64_t count = 0;
+    const uint64_t* weight_plane = &slices.weight_planes[w];
+    for (int b = 0; b < slices.n_weight_planes; ++b){
+        count += (uint64_t) __builtin_popcountll(mask & weight_plane[(size_t) b * slices.n_words]) << b;
+    }
+    return count;
+}
+
+/**
+ * Counts the number of observations for which a spin operator has value 1 (q = 2).
+ * 
+ * @param[in] slices            Bit-sliced view on the dataset.
+ * @param op                    Integer representation of the bitstring representing the operator.
+ * 
+ * @return The number of observations with an odd number of the variables in the operator equal to 1.
+ */
+uint64_t count_parity(const bit_slices& slices, __uint128_t op){
+    // Variables in the operator
+    std::vector<const uint64_t*> columns;
+    for (int j = 0; j < slices.n; ++j){
+        if ((op >> j) & 1){
+            columns.push_back(get_column(slices, j, 0));
+        }
+    }
+    int n_columns = columns.size();
+    uint64_t count = 0;
+    for (int w = 0; w < slices.n_words; ++w){
+        // XOR of the columns gives the value of the operator for 64 states at once
+        uint64_t parity = 0;
+        for (int c = 0; c < n_columns; ++c){
+            parity ^= columns[c][w];
+        }
+        count += weighted_popcount(slices, parity, w);
+    }
+    return count;
+}
+
+/**
+ * Determines if the states of a component should be counted with the bit-sliced view.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param r                     Size of the component.
+ * 
+ * @return True if the bit-sliced view exists (q = 2) and needs fewer popcounts than there are states in a word.
+ */
+bool use_sliced_counts(mcm& model, int r){
+    if (!model.data.slices || model.q != 2){
+        return false;
+    }
+    // Bound the size first, the product is only meaningful for small r and at least one weight plane
+    if (r < 1 || r > max_sliced_size || model.data.slices->n_weight_planes < 1){
+        return false;
+    }
+    return ((uint64_t) 1 << r) * model.data.slices->n_weight_planes <= max_sliced_cells;
+}
+
+/**
+ * Counts all the different observations in the dataset for a given (small) component using the bit-sliced view (q = 2).
+ * 
+ * @param[in] slices            Bit-sliced view on the dataset.
+ * @param component             Integer representation of the bitstring representing a component.
+ * @param r                     Size of the component (2^r should be at most max_sliced_cells).
+ * @param[in, out] counts       Vector that will contain the number of occurrences of every one of the 2^r states.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void count_observations_sliced(const bit_slices& slices, __uint128_t component, int r, std::vector<uint64_t>& counts){
+    int n_cells = 1 << r;
+    counts.assign(n_cells, 0);
+    const uint64_t* columns[max_sliced_cells];
+    int c = 0;
+    for (int j = 0; j < slices.n; ++j){
+        if ((component >> j) & 1){
+            columns[c++] = get_column(slices, j, 0);
+        }
+    }
+    // Masks of the states that agree with every value of the first j variables of the component
+    uint64_t masks[max_sliced_cells];
+    for (int w = 0; w < slices.n_words; ++w){
+        masks[0] = ~(uint64_t) 0;
+        for (int j = 0; j < r; ++j){
+            uint64_t column = columns[j][w];
+            // Split every mask in the states where variable j is 0 and where it is 1
+            for (int s = (1 << j) - 1; s >= 0; --s){
+                masks[2*s + 1] = masks[s] & column;
+                masks[2*s] = masks[s] & ~column;
+            }
+        }
+        for (int s = 0; s < n_cells; ++s){
+            counts[s] += weighted_popcount(slices, masks[s], w);
+        }
+    }
+}
@@ -0,0 +1,154 @@
+#include "model.h"
+
+/**
+ * Determines if the states of a component are counted with a counting table (and not with a dense array or the bit-sliced view).
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param r                     Size of the component.
+ * 
+ * @return True if the component is counted with a counting table.
+ */
+bool counted_with_table(mcm& model, int r){
+    return !use_sliced_counts(model, r) && !use_dense_counts(model, r);
+}
+
+/**
+ * Returns the index of the lowest variable in a component.
+ * 
+ * @param component             Integer representation of the bitstring representing a component (not empty).
+ * 
+ * @return Index of the lowest variable.
+ */
+static int lowest_variable(__uint128_t component){
+    uint64_t lower = (uint64_t) component;
+    return lower ? __builtin_ctzll(lower) : 64 + __builtin_ctzll((uint64_t) (component >> 64));
+}
+
+/**
+ * Finds the cached counting table of the smallest superset of a component.
+ * 
+ * Only the cached components that contain the variable of the component with the fewest cached components are checked.
+ * 
+ * @param[in] cache             Cache of counting tables.
+ * @param component             Integer representation of the bitstring representing a component.
+ * 
+ * @return Iterator to the cached table with the fewest different states that contains all variables of the component (end of the map if there is none).
+ */
+std::map<__uint128_t, count_table>::const_iterator find_superset(const count_cache& cache, __uint128_t component){
+    std::map<__uint128_t, count_table>::const_iterator best = cache.tables.end();
+    if (component == 0 || cache.containing.empty()){
+        return best;
+    }
+    // Variable of the component that is contained in the fewest cached components
+    const std::vector<__uint128_t>* candidates = nullptr;
+    for (__uint128_t rest = component; rest; rest &= rest - 1){
+        const std::vector<__uint128_t>& list = cache.containing[lowest_variable(rest)];
+        if (candidates == nullptr || list.size() < candidates->size()){
+            candidates = &list;
+        }
+    }
+    for (__uint128_t superset : *candidates){
+        if ((component & ~superset) != 0){continue;}
+        std::map<__uint128_t, count_table>::const_iterator entry = cache.tables.find(superset);
+        if (best == cache.tables.end() || entry->second.occupied.size() < best->second.occupied.size()){
+            best = entry;
+        }
+    }
+    return best;
+}
+
+/**
+ * Derives the counts of a component by marginalizing the cached table of a superset.
+ * 
+ * Only reads the cache, so it can be called from several threads at the same time.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param component             Integer representation of the bitstring representing a component.
+ * @param[in, out] counts       Counting table that will contain the distribution of the states (previous content is removed).
+ * 
+ * @return True if the counts are derived, false if there is no cached superset with fewer states than the dataset.
+ */
+bool derive_from_cache(mcm& model, __uint128_t component, count_table& counts){
+    std::map<__uint128_t, count_table>::const_iterator superset = find_superset(model.table_cache, component);
+    // Marginalizing costs one step per state of the superset instead of one per state in the dataset
+    if (superset == model.table_cache.tables.end() || superset->second.occupied.size() >= (size_t) model.data.n_states){
+        return false;
+    }
+    marginalize_table(superset->second, superset->first & ~component, counts);
+    return true;
+}
+
+/**
+ * Counts the states of a component, by marginalizing the cached table of a superset if possible.
+ * 
+ * Only reads the cache, so it can be called from several threads at the same time.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param component             Integer representation of the bitstring representing a component.
+ * @param[in, out] counts       Counting table that will contain the distribution of the states (previous content is removed).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void count_component(mcm& model, __uint128_t component, count_table& counts){
+    if (!derive_from_cache(model, component, counts)){
+        count_observations(model, component, counts);
+    }
+}
+
+/**
+ * Determines if the counting table of a component is small enough to be kept in the cache.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param[in] counts            Counting table of the component.
+ * 
+ * @return True if the table has at most half as many different states as the dataset and fits easily in the cache.
+ */
+bool worth_caching(mcm& model, const count_table& counts){
+    size_t n_keys = counts.occupied.size();
+    return 2 * n_keys <= (size_t) model.data.n_states && 64 * n_keys <= model.table_cache.max_keys;
+}
+
+/**
+ * Adds the counting table of a component to the cache and removes the oldest tables when the cache is full.
+ * 
+ * @param[in, out] cache        Cache of counting tables.
+ * @param component             Integer representation of the bitstring representing a component.
+ * @param[in, out] counts       Counting table of the component (its content is moved to the cache).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void add_to_cache(count_cache& cache, __uint128_t component, count_table& counts){
+    if (cache.tables.count(component)){return;}
+    cache.n_keys += counts.occupied.size();
+    std::swap(cache.tables[component], counts);
+    cache.order.push_back(component);
+    cache.containing.resize(128);
+    for (__uint128_t rest = component; rest; rest &= rest - 1){
+        cache.containing[lowest_variable(rest)].push_back(component);
+    }
+    while (cache.n_keys > cache.max_keys){
+        __uint128_t removed = cache.order.front();
+        std::map<__uint128_t, count_table>::iterator oldest = cache.tables.find(removed);
+        cache.n_keys -= oldest->second.occupied.size();
+        cache.tables.erase(oldest);
+        cache.order.pop_front();
+        for (__uint128_t rest = removed; rest; rest &= rest - 1){
+            std::vector<__uint128_t>& list = cache.containing[lowest_variable(rest)];
+            list.erase(std::find(list.begin(), list.end(), removed));
+        }
+    }
+}
+
+/**
+ * Removes all tables from the cache (when the dataset changes).
+ * 
+ * @param[in, out] cache        Cache of counting tables.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void clear_cache(count_cache& cache){
+    cache.tables.clear();
+    cache.order.clear();
+    cache.n_keys = 0;
+    cache.containing.clear();
+}
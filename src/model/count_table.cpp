@@ -0,0 +1,184 @@
+#include "model.h"
+
+/**
+ * Hashes a key consisting of n_ints 128bit integers.
+ * 
+ * @param[in] key               Pointer to the first of the n_ints 128bit integers of the key.
+ * @param n_ints                Number of 128bit integers in the key.
+ * 
+ * @return Hash value of the key.
+ */
+uint64_t hash_key(const __uint128_t* key, int n_ints){
+    uint64_t hash = 0;
+    for (int i = 0; i < n_ints; ++i){
+        // Mix in the lower and upper 64 bits of every integer
+        hash ^= (uint64_t) key[i];
+        hash *= 0x9E3779B97F4A7C15ULL;
+        hash ^= (uint64_t) (key[i] >> 64);
+        hash *= 0xC2B2AE3D27D4EB4FULL;
+        hash ^= hash >> 29;
+    }
+    // Final avalanche so that the lower bits (used as slot index) depend on all bits of the key
+    hash ^= hash >> 32;
+    hash *= 0xD6E8FEB86659FD93ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/**
+ * Finds the slot that contains a given key or the empty slot where it should be inserted.
+ * 
+ * @param[in] table             Counting table.
+ * @param[in] key               Pointer to the first of the n_ints 128bit integers of the key.
+ * 
+ * @return Index of the slot.
+ */
+unsigned int find_slot(const count_table& table, const __uint128_t* key){
+    int n_ints = table.n_ints;
+    unsigned int slot = hash_key(key, n_ints) & table.mask;
+    // Linear probing until the key or an empty slot is found
+    while (table.counts[slot]){
+        const __uint128_t* slot_key = &table.keys[slot * n_ints];
+        int i = 0;
+        while (i < n_ints && slot_key[i] == key[i]){++i;}
+        if (i == n_ints){
+            return slot;
+        }
+        slot = (slot + 1) & table.mask;
+    }
+    return slot;
+}
+
+/**
+ * Doubles the capacity of the counting table and reinserts all occupied slots.
+ * 
+ * @param[in, out] table        Counting table.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void grow_table(count_table& table){
+    int n_ints = table.n_ints;
+    std::vector<__uint128_t> old_keys;
+    std::vector<unsigned int> old_counts;
+    std::vector<unsigned int> old_occupied;
+    old_keys.swap(table.keys);
+    old_counts.swap(table.counts);
+    old_occupied.swap(table.occupied);
+
+    unsigned int capacity = 2 * (table.mask + 1);
+    table.mask = capacity - 1;
+    table.keys.assign((size_t) capacity * n_ints, 0);
+    table.counts.assign(capacity, 0);
+    table.occupied.reserve(capacity / 2);
+
+    // Reinsert in the original order, so iterating over 'occupied' still follows the order of insertion
+    for (unsigned int old_slot : old_occupied){
+        const __uint128_t* key = &old_keys[(size_t) old_slot * n_ints];
+        unsigned int slot = find_slot(table, key);
+        std::copy(key, key + n_ints, &table.keys[(size_t) slot * n_ints]);
+        table.counts[slot] = old_counts[old_slot];
+        table.occupied.push_back(slot);
+    }
+}
+
+/**
+ * Empties the counting table while keeping the memory it has already allocated.
+ * 
+ * @param[in, out] table        Counting table.
+ * @param n_ints                Number of 128bit integers in a key.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void reset_table(count_table& table, int n_ints){
+    if (table.n_ints != n_ints || table.counts.empty()){
+        // First use (or different key width) -> allocate the initial slots
+        unsigned int capacity = 1024;
+        table.n_ints = n_ints;
+        table.mask = capacity - 1;
+        table.keys.assign((size_t) capacity * n_ints, 0);
+        table.counts.assign(capacity, 0);
+        table.occupied.clear();
+        table.occupied.reserve(capacity / 2);
+        return;
+    }
+    // Only the occupied slots have to be cleared
+    for (unsigned int slot : table.occupied){
+        table.counts[slot] = 0;
+    }
+    table.occupied.clear();
+}
+
+/**
+ * Increases the count of a key in the counting table.
+ * 
+ * @param[in, out] table        Counting table.
+ * @param[in] key               Pointer to the first of the n_ints 128bit integers of the key.
+ * @param weight                Value by which the count is increased (should be larger than zero).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void add_to_table(count_table& table, const __uint128_t* key, unsigned int weight){
+    // Keep the load factor below 1/2
+    if (2 * (table.occupied.size() + 1) > table.mask + 1){
+        grow_table(table);
+    }
+    unsigned int slot = find_slot(table, key);
+    if (table.counts[slot] == 0){
+        // New key
+        std::copy(key, key + table.n_ints, &table.keys[(size_t) slot * table.n_ints]);
+        table.occupied.push_back(slot);
+    }
+    table.counts[slot] += weight;
+}
+
+/**
+ * Returns the count of a key in the counting table.
+ * 
+ * @param[in] table             Counting table.
+ * @param[in] key               Pointer to the first of the n_ints 128bit integers of the key.
+ * 
+ * @return The count of the key, which is zero if the key is not in the table.
+ */
+unsigned int table_count(const count_table& table, const __uint128_t* key){
+    if (table.counts.empty()){
+        return 0;
+    }
+    return table.counts[find_slot(table, key)];
+}
+
+/**
+ * Derives the counting table of a component without some of its variables by summing the counts over the values of every variable in the mask.
+ * 
+ * @param[in] table             Counting table of the component.
+ * @param removed               Integer representation of the bitstring with the variable(s) that are removed.
+ * @param[in, out] result       Counting table that will contain the counts without these variables (previous content is removed).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void marginalize_table(const count_table& table, __uint128_t removed, count_table& result){
+    int n_ints = table.n_ints;
+    reset_table(result, n_ints);
+    std::vector<__uint128_t> key(n_ints);
+    for (unsigned int slot : table.occupied){
+        const __uint128_t* slot_key = &table.keys[(size_t) slot * n_ints];
+        // Clear the bits of the removed variables in every plane
+        for (int i = 0; i < n_ints; ++i){
+            key[i] = slot_key[i] & ~removed;
+        }
+        add_to_table(result, key.data(), table.counts[slot]);
+    }
+}
+
+/**
+ * Adds all counts of one counting table to another one.
+ * 
+ * @param[in, out] table        Counting table that will contain the sum of both tables (new keys are added in the order of the other table).
+ * @param[in] other             Counting table that is added.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void add_table(count_table& table, const count_table& other){
+    for (unsigned int slot : other.occupied){
+        add_to_table(table, &other.keys[(size_t) slot * other.n_ints], other.counts[slot]);
+    }
+}
@@ -1,35 +1,183 @@
 #include "model.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Allocates one contiguous, 64-byte aligned buffer for the states and the weights of a dataset.
+ * 
+ * @param[in, out] data         View on the dataset that will refer to the new buffer (weights are initialized to 1).
+ * @param n_states              Number of states.
+ * @param n_ints                Number of 128bit integers necessary to represent a state.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void allocate_dataset(dataset& data, int n_states, int n_ints){
+    // The weights start at the first cache line after the states
+    size_t states_bytes = (size_t) n_states * n_ints * sizeof(__uint128_t);
+    size_t weights_offset = (states_bytes + 63) / 64 * 64;
+    size_t total_bytes = weights_offset + (size_t) n_states * sizeof(unsigned int);
+
+    void* buffer = nullptr;
+    if (posix_memalign(&buffer, 64, std::max(total_bytes, (size_t) 64))){
+        throw std::bad_alloc();
+    }
+    data.memory = std::shared_ptr<void>(buffer, free);
+    data.n_states = n_states;
+    data.n_ints = n_ints;
+    data.states = (__uint128_t*) buffer;
+    data.weights = (unsigned int*) ((char*) buffer + weights_offset);
+    std::fill(data.weights, data.weights + n_states, 1);
+}
+
+/**
+ * Returns a copy of a single state of a dataset.
+ * 
+ * @param[in] data              View on the dataset.
+ * @param i                     Index of the state.
+ * 
+ * @return Vector with the n_ints 128bit integers representing state i.
+ */
+std::vector<__uint128_t> get_state(const dataset& data, int i){
+    const __uint128_t* state = data.states + (size_t) i * data.n_ints;
+    return std::vector<__uint128_t>(state, state + data.n_ints);
+}
+
 /**
  * Reads in and processes the dataset.
  * 
+ * The file is memory-mapped and split into chunks at line boundaries, which are parsed in parallel directly into the buffer of the dataset.
+ * 
  * @param file                  Path to the file.
  * @param n                     Number of variables in the system
  * @param n_ints                Number of 128bit integers necessary to represent the data
+ * @param q                     Number of values a single variable can take (0 only checks that the values fit in n_ints bits)
  * 
- * @return The processed dataset, which is an empty vector if the file is not found.
+ * @return The processed dataset with every observation as a separate state, which is empty if the file is not found or has no valid observation
+ *                              (empty lines are skipped, malformed lines are reported and skipped).
  */
-std::vector<std::vector<__uint128_t>> data_processing(std::string file, int n, int n_ints){
-    // Open file
-    std::ifstream myfile(file);
-
-    // Store dataset as vector of vectors containing n_ints 128bit integers
-    std::vector<std::vector<__uint128_t>> data;
+dataset data_processing(std::string file, int n, int n_ints, int q){
+    // Store dataset as one buffer with n_ints 128bit integers per observation
+    dataset data;
 
+    // Open file
+    int fd = open(file.c_str(), O_RDONLY);
     // Check if file exists
-    if (myfile.fail()){
+    if (fd < 0){
         std::cout << "Not able to open the file." << std::endl;
         return data;
     }
+    struct stat file_info;
+    if (fstat(fd, &file_info) != 0 || file_info.st_size == 0){
+        close(fd);
+        return data;
+    }
+    size_t size = file_info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED){
+        std::cout << "Not able to read the file." << std::endl;
+        return data;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    const char* text = (const char*) mapping;
+    const char* text_end = text + size;
+
+    // Split the file into chunks that start at the beginning of a line
+    size_t chunk_size = std::max(size / (4 * get_num_threads()) + 1, (size_t) 1 << 20);
+    std::vector<const char*> chunk_start(1, text);
+    while (chunk_start.back() + chunk_size < text_end){
+        const char* next = (const char*) memchr(chunk_start.back() + chunk_size, '\n', text_end - chunk_start.back() - chunk_size);
+        if (next == nullptr || next + 1 == text_end){break;}
+        chunk_start.push_back(next + 1);
+    }
+    int n_chunks = chunk_start.size();
+    chunk_start.push_back(text_end);
+
+    // Count the number of lines in every chunk (the last line does not need to end with a newline)
+    std::vector<size_t> n_lines(n_chunks + 1, 0);
+    parallel_for(n_chunks, [&](int c){
+        size_t count = std::count(chunk_start[c], chunk_start[c+1], '\n');
+        if (c == n_chunks - 1 && *(text_end - 1) != '\n'){
+            ++count;
+        }
+        n_lines[c+1] = count;
+    });
+    // Index of the first line of every chunk
+    for (int c = 0; c < n_chunks; ++c){
+        n_lines[c+1] += n_lines[c];
+    }
+    // The number of states and the number of observations (N) are stored as int
+    if (n_lines[n_chunks] > (size_t) INT_MAX){
+        munmap(mapping, size);
+        std::cout << "The file contains " << n_lines[n_chunks] << " lines, the maximum number of observations is " << INT_MAX << "." << std::endl;
+        return data;
+    }
+    allocate_dataset(data, n_lines[n_chunks], n_ints);
+
+    // Convert the observations and store them at the position of their line in the dataset
+    std::vector<std::vector<size_t>> malformed(n_chunks);
+    std::vector<char> skipped(n_lines[n_chunks], 0);
+    parallel_for(n_chunks, [&](int c){
+        const char* line = chunk_start[c];
+        size_t i = n_lines[c];
+        while (line < chunk_start[c+1]){
+            const char* line_end = (const char*) memchr(line, '\n', chunk_start[c+1] - line);
+            if (line_end == nullptr){
+                line_end = chunk_start[c+1];
+            }
+            // Ignore the carriage return of files with Windows line endings
+            size_t length = line_end - line;
+            if (length && line[length-1] == '\r'){
+                --length;
+            }
+            if (length == 0){
+                // Empty lines are skipped silently
+                skipped[i] = 1;
+            }
+            // Only the first n variables of the observation are used
+            else if (length < (size_t) n || !convert_observation(data.states + i * n_ints, line, n, n_ints, q)){
+                malformed[c].push_back(i + 1);
+                skipped[i] = 1;
+            }
+            line = line_end + 1;
+            ++i;
+        }
+    });
+    munmap(mapping, size);
+
+    // Report the malformed lines
+    size_t n_malformed = 0;
+    for (std::vector<size_t>& lines : malformed){
+        for (size_t line_number : lines){
+            if (n_malformed < 10){
+                std::cout << "Line " << line_number << " is malformed (expected " << n << " values), it is skipped." << std::endl;
+            }
+            ++n_malformed;
+        }
+    }
+    if (n_malformed){
+        std::cout << n_malformed << " malformed line(s) in the file are skipped." << std::endl;
+    }
 
-    std::string line;
-    std::vector<__uint128_t> observation(n_ints);
-    while (getline(myfile, line)) {
-        // Exctract the first n variables from the observation
-        line = line.substr(0, n);
-        // Convert the observation and add it to the dataset
-        convert_observation(observation, line, n);
-        data.push_back(observation);
+    // Move the observations after the skipped lines to the front
+    int n_obs = 0;
+    for (int i = 0; i < data.n_states; ++i){
+        if (skipped[i]){continue;}
+        if (n_obs != i){
+            std::copy(data.states + (size_t) i * n_ints, data.states + (size_t) (i + 1) * n_ints, data.states + (size_t) n_obs * n_ints);
+        }
+        ++n_obs;
+    }
+    data.n_states = n_obs;
+    if (n_obs == 0){
+        std::cout << "The file does not contain any valid observation." << std::endl;
+        return dataset();
     }
     return data;
 }
@@ -37,21 +185,28 @@ std::vector<std::vector<__uint128_t>> data_processing(std::string file, int n, i
 /**
  * Converts the data from a string to log2(q) 128bit integers.
  * 
- * @param[in, out] obs          Vector of log2(q) 128bit integers that will contain the converted observation.
- * @param[in] raw_obs           The observation as a string of length n.
+ * @param[in, out] obs          Pointer to the log2(q) 128bit integers that will contain the converted observation.
+ * @param[in] raw_obs           Pointer to the first character of the observation (at least n characters).
  * @param n                     Number of variables in the system.
+ * @param n_ints                Number of 128bit integers necessary to represent the data
+ * @param q                     Number of values a single variable can take (0 only checks that the values fit in n_ints bits)
  * 
- * @return void                 Nothing is returned by this function.
+ * @return True if all n characters are valid values, false otherwise.
  */
-void convert_observation(std::vector<__uint128_t>& obs, std::string& raw_obs, int n){
+bool convert_observation(__uint128_t* obs, const char* raw_obs, int n, int n_ints, int q){
     // Set all elements equal to zero
-    std::fill(obs.begin(), obs.end(), 0);
+    std::fill(obs, obs + n_ints, 0);
+    // Largest valid value
+    int max_value = q ? q - 1 : (1 << n_ints) - 1;
     // Variable for the integer value of the ith bit
     __uint128_t element = 1;
     // Loop over the variables
     for (int i = 0; i < n; ++i){
         // Convert value of variable i from string to integer
         int value = raw_obs[i] - '0';
+        if (value < 0 || value > max_value){
+            return false;
+        }
         int bit = 0;
         while (value){
             // Check if last bit in the binary representation is nonzero
@@ -65,4 +220,243 @@ void convert_observation(std::vector<__uint128_t>& obs, std::string& raw_obs, in
         // Bitshift to the left to get the decimal value of the next variable
         element <<= 1;
     }
-}
\ No newline at end of file
+    return true;
+}
+
+/**
+ * Stores a dataset in the model as the different states that occur together with their multiplicity.
+ * 
+ * @param[in, out] model        Struct containing the characteristic of the model.
+ *                              -'data' will contain every state of the dataset once (in order of first occurrence) with its number of occurrences.
+ *                              -'N' will be the total number of observations.
+ * @param[in] data              Dataset containing all observations represented as n_ints 128bit integers.
+ * 
+ * @return True if the data is stored, false if the total number of observations is larger than the range of 'N'.
+ */
+bool load_data(mcm& model, dataset& data){
+    // The total number of observations should fit in N (and in the counts of the states)
+    uint64_t n_observations = 0;
+    for (int i = 0; i < data.n_states; ++i){
+        n_observations += data.weights[i];
+    }
+    if (n_observations > (uint64_t) INT_MAX){
+        std::cout << "The dataset contains " << n_observations << " observations, the maximum is " << INT_MAX << "." << std::endl;
+        return false;
+    }
+    model.N = n_observations;
+
+    // Count the occurrences of every full observation
+    count_table counts;
+    reset_table(counts, model.n_ints);
+    for (int i = 0; i < data.n_states; ++i){
+        add_to_table(counts, data.states + (size_t) i * data.n_ints, data.weights[i]);
+    }
+
+    // Copy the different states to a new buffer
+    allocate_dataset(model.data, counts.occupied.size(), model.n_ints);
+    for (int i = 0; i < model.data.n_states; ++i){
+        unsigned int slot = counts.occupied[i];
+        std::copy(&counts.keys[(size_t) slot * model.n_ints], &counts.keys[(size_t) (slot + 1) * model.n_ints], model.data.states + (size_t) i * model.n_ints);
+        model.data.weights[i] = counts.counts[slot];
+    }
+    // Counting tables of the previous dataset are no longer valid
+    clear_cache(model.table_cache);
+    init_evidence_terms(model);
+    return true;
+}
+
+/**
+ * Header of a dataset in the binary format (.mcmb).
+ * 
+ * The header is followed by the states (n_states * n_ints 128bit integers) and, starting at the next multiple of 64 bytes, the weights (n_states 32bit integers).
+ * This is the same layout as the buffer of a dataset, such that a memory-mapped file can be used without copying.
+ */
+struct binary_header {
+    char magic[4];
+    uint32_t version;
+    int32_t n;
+    int32_t q;
+    int32_t n_ints;
+    int32_t reserved;
+    uint64_t N;
+    uint64_t n_states;
+    uint64_t checksum;
+    char padding[16];
+};
+static_assert(sizeof(binary_header) == 64, "The states in a binary dataset should start at a multiple of 64 bytes");
+
+/**
+ * Calculates a checksum of the states and weights of a dataset.
+ * 
+ * The buffer is split into blocks of 1MB whose hashes are combined, such that the blocks can be processed in parallel.
+ * 
+ * @param[in] data              View on the dataset.
+ * 
+ * @return The checksum.
+ */
+uint64_t data_checksum(const dataset& data){
+    size_t states_bytes = (size_t) data.n_states * data.n_ints * sizeof(__uint128_t);
+    size_t n_words = states_bytes / 8;
+    size_t n_weight_words = ((size_t) data.n_states + 1) / 2;
+    size_t block_size = 1 << 17;
+    size_t n_blocks = (n_words + n_weight_words + block_size - 1) / block_size;
+
+    std::vector<uint64_t> block_hash(n_blocks, 0);
+    parallel_for(n_blocks, [&](int b){
+        uint64_t hash = 0x84222325CBF29CE4ULL ^ (uint64_t) b;
+        for (size_t i = b * block_size; i < std::min((b + 1) * block_size, n_words + n_weight_words); ++i){
+            uint64_t word;
+            if (i < n_words){
+                memcpy(&word, (const char*) data.states + 8 * i, 8);
+            }
+            else{
+                // Pairs of weights (the last weight is paired with zero if the number of states is odd)
+                size_t j = 2 * (i - n_words);
+                word = data.weights[j];
+                if (j + 1 < (size_t) data.n_states){
+                    word |= (uint64_t) data.weights[j+1] << 32;
+                }
+            }
+            hash = (hash ^ word) * 0x100000001B3ULL;
+            hash ^= hash >> 31;
+        }
+        block_hash[b] = hash;
+    });
+    uint64_t checksum = 0;
+    for (uint64_t hash : block_hash){
+        checksum = (checksum ^ hash) * 0x9E3779B97F4A7C15ULL;
+    }
+    return checksum;
+}
+
+/**
+ * Calculates the checksum of a binary dataset, which covers the states, the weights and the number of observations.
+ * 
+ * @param[in] data              View on the dataset.
+ * @param N                     Total number of observations stored in the header.
+ * 
+ * @return The checksum.
+ */
+uint64_t binary_checksum(const dataset& data, uint64_t N){
+    uint64_t hash = (data_checksum(data) ^ N) * 0x100000001B3ULL;
+    return hash ^ (hash >> 31);
+}
+
+/**
+ * Writes the dataset of the model to a file in the binary format (.mcmb).
+ * 
+ * @param file                  Path to the file.
+ * @param[in] model             Struct containing the characteristic of the model (with the processed dataset).
+ * 
+ * @return True if the file is written, false otherwise.
+ */
+bool write_binary(std::string file, mcm& model){
+    std::ofstream output(file, std::ios::binary);
+    if (output.fail()){
+        std::cout << "Not able to create the file." << std::endl;
+        return false;
+    }
+    binary_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "MCMB", 4);
+    header.version = 2;
+    header.n = model.n;
+    header.q = model.q;
+    header.n_ints = model.n_ints;
+    header.N = model.N;
+    header.n_states = model.data.n_states;
+    header.checksum = binary_checksum(model.data, header.N);
+    output.write((const char*) &header, sizeof(header));
+
+    // States followed by the weights at the next multiple of 64 bytes
+    size_t states_bytes = (size_t) model.data.n_states * model.n_ints * sizeof(__uint128_t);
+    size_t weights_offset = (states_bytes + 63) / 64 * 64;
+    output.write((const char*) model.data.states, states_bytes);
+    std::vector<char> padding(weights_offset - states_bytes, 0);
+    output.write(padding.data(), padding.size());
+    output.write((const char*) model.data.weights, (size_t) model.data.n_states * sizeof(unsigned int));
+    output.close();
+    return !output.fail();
+}
+
+/**
+ * Reads in a dataset in the binary format (.mcmb) by memory-mapping the file.
+ * 
+ * @param file                  Path to the file.
+ * @param[in, out] model        Struct containing the characteristic of the model.
+ *                              -'data' will refer to the states and weights in the memory-mapped file.
+ *                              -'N' will be the total number of observations.
+ * 
+ * @return True if the dataset is read in, false if the file is not found, does not match the model or is corrupted.
+ */
+bool read_binary(std::string file, mcm& model){
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0){
+        std::cout << "Not able to open the file." << std::endl;
+        return false;
+    }
+    struct stat file_info;
+    if (fstat(fd, &file_info) != 0 || (size_t) file_info.st_size < sizeof(binary_header)){
+        std::cout << "The file is not a valid binary dataset." << std::endl;
+        close(fd);
+        return false;
+    }
+    size_t size = file_info.st_size;
+    // Private mapping -> the states can be modified (gauge transformation) without changing the file
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED){
+        std::cout << "Not able to read the file." << std::endl;
+        return false;
+    }
+    std::shared_ptr<void> memory(mapping, [size](void* p){munmap(p, size);});
+
+    // Check the header
+    binary_header header;
+    memcpy(&header, mapping, sizeof(header));
+    if (memcmp(header.magic, "MCMB", 4) != 0 || header.version != 2){
+        std::cout << "The file is not a valid binary dataset." << std::endl;
+        return false;
+    }
+    if (header.n != model.n || header.q != model.q || header.n_ints != model.n_ints){
+        std::cout << "The binary dataset has n = " << header.n << " and q = " << header.q << ", which does not match the model." << std::endl;
+        return false;
+    }
+    // Bound the number of states by the size of the file before computing the size of the buffer (no overflow for a corrupted header)
+    if (header.n_states > (size - sizeof(header)) / (model.n_ints * sizeof(__uint128_t)) || header.n_states > (uint64_t) INT_MAX){
+        std::cout << "The file is not a valid binary dataset." << std::endl;
+        return false;
+    }
+    size_t states_bytes = header.n_states * model.n_ints * sizeof(__uint128_t);
+    size_t weights_offset = (states_bytes + 63) / 64 * 64;
+    if (size < sizeof(header) + weights_offset + header.n_states * sizeof(unsigned int)){
+        std::cout << "The file is not a valid binary dataset." << std::endl;
+        return false;
+    }
+
+    // The states and weights are used directly from the mapped memory
+    dataset data;
+    data.n_states = header.n_states;
+    data.n_ints = header.n_ints;
+    data.states = (__uint128_t*) ((char*) mapping + sizeof(header));
+    data.weights = (unsigned int*) ((char*) mapping + sizeof(header) + weights_offset);
+    data.memory = memory;
+    if (binary_checksum(data, header.N) != header.checksum){
+        std::cout << "The binary dataset is corrupted (checksum mismatch)." << std::endl;
+        return false;
+    }
+    // The number of observations should be the sum of the weights and fit in N
+    uint64_t n_observations = 0;
+    for (int i = 0; i < data.n_states; ++i){
+        n_observations += data.weights[i];
+    }
+    if (n_observations != header.N || header.N > (uint64_t) INT_MAX){
+        std::cout << "The binary dataset is corrupted (wrong number of observations)." << std::endl;
+        return false;
+    }
+    model.data = data;
+    clear_cache(model.table_cache);
+    model.N = header.N;
+    init_evidence_terms(model);
+    return true;
+}
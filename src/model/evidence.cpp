@@ -1,27 +1,257 @@
 #include "model.h"
 
+#include <atomic>
+
+/**
+ * Distribution of the counts of the states of a component (count of counts), from which the log evidence is summed.
+ * 
+ * The log evidence only depends on how many states have a given count, so small counts are only counted
+ * and their contributions are added with one dot product with the precomputed log gamma terms.
+ */
+struct count_histogram {
+    // Number of states with count k, for every k below n_small_counts
+    uint64_t small[n_small_counts] = {};
+    // Sum of the log gamma terms of the states with a larger count
+    double large = 0;
+};
+
+/**
+ * Adds the count of a state to the distribution of the counts.
+ * 
+ * @param[in, out] histogram    Distribution of the counts.
+ * @param count                 Count of the state (larger than zero).
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+static inline void add_count(count_histogram& histogram, uint64_t count, const mcm& model){
+    if (count < n_small_counts){
+        ++histogram.small[count];
+    }
+    else if (count < model.log_gamma.size()){
+        histogram.large += model.log_gamma[count];
+    }
+    else{
+        histogram.large += (lgamma(count + 0.5) - 0.5 * log(M_PI));
+    }
+}
+
+/**
+ * Sums the log gamma terms of all states in the distribution of the counts.
+ * 
+ * @param[in] histogram         Distribution of the counts.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return Part of the log evidence that depends on the counts of the states.
+ */
+static double histogram_evidence(const count_histogram& histogram, const mcm& model){
+    int n_terms = std::min((size_t) n_small_counts, model.log_gamma.size());
+    double log_evidence = histogram.large;
+    for (int k = 1; k < n_terms; ++k){
+        log_evidence += histogram.small[k] * model.log_gamma[k];
+    }
+    // Small counts without a precomputed term (only if the table is not initialized for the dataset)
+    for (int k = std::max(n_terms, 1); k < n_small_counts; ++k){
+        if (histogram.small[k]){
+            log_evidence += histogram.small[k] * (lgamma(k + 0.5) - 0.5 * log(M_PI));
+        }
+    }
+    return log_evidence;
+}
+
 /**
  * Counts all the different observations in the dataset for a given component.
  * 
  * @param[in] model             Struct containing the characteristic of the model. 
  * @param component             Integer representation of the bitstring representing a component.
+ * @param[in, out] counts       Counting table that will contain the distribution of the states that occur (previous content is removed).
  * 
- * @return Distribution of the states that occur as a map.   
+ * @return void                 Nothing is returned by this function.
  */
-std::map<std::vector<__uint128_t>, unsigned int> count_observations(mcm& model, __uint128_t component){
-    // Map to keep track of the frequency of the observations
-    std::map<std::vector<__uint128_t>, unsigned int> counts;
+void count_observations(mcm& model, __uint128_t component, count_table& counts){
+    // Reuse the memory of the table from the previous call
+    reset_table(counts, model.n_ints);
     std::vector<__uint128_t> state(model.n_ints);
-    // Loop over the entire dataset
-    for (const std::vector<__uint128_t>& obs : model.data){
+    // Loop over all different states in the dataset
+    const dataset& data = model.data;
+    for (int j = 0; j < data.n_states; ++j){
+        const __uint128_t* obs = data.states + (size_t) j * model.n_ints;
         // Bitwise AND to extract the substring corresponding to the component
         for (int i = 0; i < model.n_ints; ++i){
             state[i] = obs[i] & component;
         }
-        // Increase frequency of the state by 1
-        counts[state] += 1;   
+        // Increase frequency of the state by the number of times the full state occurs
+        add_to_table(counts, state.data(), data.weights[j]);
+    }
+}
+
+/**
+ * Determines if the observations of large components are counted in parallel over shards of the dataset.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return True if the dataset has enough different states.
+ */
+bool use_parallel_counts(mcm& model){
+    return model.data.n_states >= min_parallel_states;
+}
+
+/**
+ * Counts all the different observations in the dataset for a given component with several threads.
+ * 
+ * Every thread counts a shard of the dataset in its own tables, one for each part of the state space (selected by the hash of the state).
+ * The tables of the shards are then merged part by part in parallel, in the order of the shards,
+ * so the states in a part are in the same order as in a serial count, whatever the number of threads.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param component             Integer representation of the bitstring representing a component.
+ * @param[in, out] parts        Vector that will contain the n_count_parts counting tables of the parts of the state space.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void count_observations_parallel(mcm& model, __uint128_t component, std::vector<count_table>& parts){
+    const dataset& data = model.data;
+    int n_shards = std::max(1, std::min(get_num_threads(), data.n_states / min_shard_states));
+    int64_t shard_size = (data.n_states + n_shards - 1) / n_shards;
+    int part_shift = 64 - __builtin_ctz(n_count_parts);
+
+    // Count every shard of the dataset in its own tables
+    std::vector<std::vector<count_table>> shard_parts(n_shards, std::vector<count_table>(n_count_parts));
+    parallel_for(n_shards, [&](int s){
+        std::vector<count_table>& tables = shard_parts[s];
+        for (count_table& table : tables){
+            reset_table(table, model.n_ints);
+        }
+        std::vector<__uint128_t> state(model.n_ints);
+        int64_t end = std::min((int64_t) data.n_states, (s + 1) * shard_size);
+        for (int64_t j = s * shard_size; j < end; ++j){
+            const __uint128_t* obs = data.states + (size_t) j * model.n_ints;
+            for (int i = 0; i < model.n_ints; ++i){
+                state[i] = obs[i] & component;
+            }
+            add_to_table(tables[hash_key(state.data(), model.n_ints) >> part_shift], state.data(), data.weights[j]);
+        }
+    });
+
+    // Merge the shards part by part
+    parts.resize(n_count_parts);
+    parallel_for(n_count_parts, [&](int p){
+        std::swap(parts[p], shard_parts[0][p]);
+        for (int s = 1; s < n_shards; ++s){
+            add_table(parts[p], shard_parts[s][p]);
+        }
+    });
+}
+
+/**
+ * Prepares the extraction of the bits of a component from 128bit integers.
+ * 
+ * @param[in, out] extractor    Struct that will contain the lookup tables for the component.
+ * @param component             Integer representation of the bitstring representing a component.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void init_extractor(bit_extractor& extractor, __uint128_t component){
+    extractor.component = component;
+    extractor.n_bytes = 0;
+    int shift = 0;
+    // Loop over the 16 bytes of the 128bit integer
+    for (int byte = 0; byte < 16; ++byte){
+        int mask = (component >> (8 * byte)) & 0xff;
+        if (mask == 0){continue;}
+        int k = extractor.n_bytes;
+        extractor.byte_index[k] = byte;
+        extractor.shift[k] = shift;
+        // Packed representation of the bits of the component for every possible value of this byte
+        for (int value = 0; value < 256; ++value){
+            int packed = 0;
+            int bit = 0;
+            for (int i = 0; i < 8; ++i){
+                if (mask & (1 << i)){
+                    if (value & (1 << i)){
+                        packed |= (1 << bit);
+                    }
+                    ++bit;
+                }
+            }
+            extractor.lut[k][value] = packed;
+        }
+        shift += count_set_bits(mask);
+        ++extractor.n_bytes;
+    }
+}
+
+/**
+ * Extracts the bits of a component from a 128bit integer and packs them into the lowest bits.
+ * 
+ * @param[in] extractor         Struct containing the lookup tables for the component.
+ * @param value                 128bit integer from which the bits are extracted.
+ * 
+ * @return Integer with the extracted bits in the lowest positions (in the same order as in the component).
+ */
+uint32_t extract_bits(const bit_extractor& extractor, __uint128_t value){
+#ifdef __BMI2__
+    // Hardware PEXT on both 64bit halves
+    uint64_t low_mask = (uint64_t) extractor.component;
+    uint64_t low = _pext_u64((uint64_t) value, low_mask);
+    uint64_t high = _pext_u64((uint64_t) (value >> 64), (uint64_t) (extractor.component >> 64));
+    return low | (high << __builtin_popcountll(low_mask));
+#else
+    uint32_t packed = 0;
+    for (int k = 0; k < extractor.n_bytes; ++k){
+        int byte = (value >> (8 * extractor.byte_index[k])) & 0xff;
+        packed |= (uint32_t) extractor.lut[k][byte] << extractor.shift[k];
+    }
+    return packed;
+#endif
+}
+
+/**
+ * Determines if the states of a component can be counted in a dense array instead of a hash table.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model. 
+ * @param r                     Size of the component.
+ * 
+ * @return True if the dense array has at most 2^20 cells and is not much larger than the number of different states in the dataset.
+ */
+bool use_dense_counts(mcm& model, int r){
+    // Every plane contributes r bits to the index of a cell
+    int n_bits = r * model.n_ints;
+    if (n_bits > 20){
+        return false;
+    }
+    // All cells are visited to collect the counts -> avoid arrays that are much larger than the number of states that are scanned
+    return ((size_t) 1 << n_bits) <= 8 * (size_t) model.data.n_states;
+}
+
+/**
+ * Counts all the different observations in the dataset for a given (small) component using a dense array.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model. 
+ * @param component             Integer representation of the bitstring representing a component.
+ * @param r                     Size of the component.
+ * @param[in, out] counts       Vector that will contain the number of occurrences of every state (should contain only zeros).
+ *                              The index of a state is the concatenation of the extracted bits of the component in every plane.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void count_observations_dense(mcm& model, __uint128_t component, int r, std::vector<unsigned int>& counts){
+    size_t n_cells = (size_t) 1 << (r * model.n_ints);
+    if (counts.size() < n_cells){
+        counts.resize(n_cells, 0);
+    }
+    bit_extractor extractor;
+    init_extractor(extractor, component);
+    // Loop over all different states in the dataset
+    const dataset& data = model.data;
+    for (int j = 0; j < data.n_states; ++j){
+        const __uint128_t* obs = data.states + (size_t) j * model.n_ints;
+        uint32_t index = 0;
+        for (int i = 0; i < model.n_ints; ++i){
+            index |= extract_bits(extractor, obs[i]) << (i * r);
+        }
+        counts[index] += data.weights[j];
     }
-    return counts;
 }
 
 /**
@@ -41,7 +271,39 @@ double get_evidence_icc(__uint128_t component, mcm& model){
         if (result == model.evidence_storage.end()){
             // Not found -> needs to be calculated
             int r = component_size(component);
-            log_evidence = calc_evidence_icc(component, model, r);
+            if (counted_with_table(model, r)){
+                // Count from a cached superset if possible and keep the table for later subsets
+                count_table counts;
+                if (derive_from_cache(model, component, counts)){
+                    log_evidence = evidence_from_table(counts, r, model);
+                }
+                else if (use_parallel_counts(model)){
+                    // Large dataset -> count the shards of the dataset in parallel and only join the parts of a small table
+                    std::vector<count_table> parts;
+                    count_observations_parallel(model, component, parts);
+                    log_evidence = evidence_from_parts(parts, r, model);
+                    size_t n_keys = 0;
+                    for (count_table& part : parts){
+                        n_keys += part.occupied.size();
+                    }
+                    if (2 * n_keys <= (size_t) model.data.n_states){
+                        reset_table(counts, model.n_ints);
+                        for (count_table& part : parts){
+                            add_table(counts, part);
+                        }
+                    }
+                }
+                else{
+                    count_observations(model, component, counts);
+                    log_evidence = evidence_from_table(counts, r, model);
+                }
+                if (worth_caching(model, counts)){
+                    add_to_cache(model.table_cache, component, counts);
+                }
+            }
+            else{
+                log_evidence = calc_evidence_icc(component, model, r);
+            }
             // Store the result
             model.evidence_storage[component] = log_evidence;
         }
@@ -64,6 +326,212 @@ double get_evidence_icc(__uint128_t component, mcm& model){
     return log_evidence;
 }
 
+/**
+ * Calculates the log evidence of a list of components in parallel and adds the ones that were not calculated yet to a storage.
+ * 
+ * The storage and the cache of counting tables are only changed after the parallel part, so the components can be evaluated independently.
+ * 
+ * @param[in] components        Vector of integers representing the components (may contain duplicates).
+ * @param[in, out] model        Struct containing the characteristic of the model.
+ * @param[in, out] storage      Map from the components to their log evidence.
+ * @param fill_cache            Boolean to indicate if small counting tables are added to the cache of the model
+ *                              (only if no other thread uses the cache at the same time).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void get_evidence_batch(const std::vector<__uint128_t>& components, mcm& model, std::map<__uint128_t, double>& storage, bool fill_cache){
+    // Components that are not in the storage yet (without duplicates)
+    std::vector<__uint128_t> missing;
+    for (__uint128_t component : components){
+        if (storage.count(component) == 0){
+            missing.push_back(component);
+        }
+    }
+    std::sort(missing.begin(), missing.end());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+    std::vector<double> log_evidence(missing.size());
+    std::vector<count_table> tables(fill_cache ? missing.size() : 0);
+    // Number of states in the tables that are kept for the cache
+    std::atomic<size_t> n_kept(0);
+    auto keep_table = [&](int i, count_table& table){
+        if (fill_cache && worth_caching(model, table) && (n_kept += table.occupied.size()) <= model.table_cache.max_keys){
+            std::swap(tables[i], table);
+        }
+    };
+
+    // Components counted with the bit-sliced view or derived from a cached table do not need a pass over the dataset
+    std::vector<char> scan(missing.size(), 0);
+    parallel_for(missing.size(), [&](int i){
+        int r = component_size(missing[i]);
+        static thread_local count_table counts;
+        if (use_sliced_counts(model, r)){
+            log_evidence[i] = calc_evidence_icc(missing[i], model, r);
+        }
+        else if (counted_with_table(model, r) && derive_from_cache(model, missing[i], counts)){
+            log_evidence[i] = evidence_from_table(counts, r, model);
+            keep_table(i, counts);
+        }
+        else{
+            scan[i] = 1;
+        }
+    });
+
+    // The other components are counted in groups, with one pass over the dataset per group
+    std::vector<int> scanned;
+    for (size_t i = 0; i < missing.size(); ++i){
+        if (scan[i]){scanned.push_back(i);}
+    }
+    int group_size = std::max(1, std::min(max_group_size, (int) scanned.size() / (4 * get_num_threads())));
+    int n_groups = (scanned.size() + group_size - 1) / group_size;
+    parallel_for(n_groups, [&](int g){
+        int begin = g * group_size;
+        int end = std::min(begin + group_size, (int) scanned.size());
+        std::vector<__uint128_t> group;
+        for (int k = begin; k < end; ++k){
+            group.push_back(missing[scanned[k]]);
+        }
+        std::vector<double> group_evidence;
+        std::vector<count_table> group_tables;
+        calc_evidence_group(model, group, group_evidence, group_tables);
+        for (int k = begin; k < end; ++k){
+            log_evidence[scanned[k]] = group_evidence[k - begin];
+            keep_table(scanned[k], group_tables[k - begin]);
+        }
+    });
+
+    // Store the results
+    for (size_t i = 0; i < missing.size(); ++i){
+        storage[missing[i]] = log_evidence[i];
+        if (fill_cache && !tables[i].occupied.empty()){
+            add_to_cache(model.table_cache, missing[i], tables[i]);
+        }
+    }
+}
+
+/**
+ * Calculates the log evidence of a group of components with a single pass over the dataset.
+ * 
+ * The dataset is processed in blocks that stay in the cache of the processor while the states of all components in the group are counted,
+ * so the data is read from memory once for the whole group instead of once per component.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param[in] components        Components in the group (counted with a dense array or a counting table).
+ * @param[in, out] log_evidence Vector that will contain the log evidence of every component.
+ * @param[in, out] tables       Vector that will contain the counting table of every component that is counted with a table (empty for the others).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void calc_evidence_group(mcm& model, const std::vector<__uint128_t>& components, std::vector<double>& log_evidence, std::vector<count_table>& tables){
+    int n_components = components.size();
+    const dataset& data = model.data;
+    std::vector<int> r(n_components);
+    std::vector<bool> dense(n_components);
+    std::vector<bit_extractor> extractors(n_components);
+    std::vector<std::vector<unsigned int>> dense_counts(n_components);
+    tables.assign(n_components, count_table());
+    for (int c = 0; c < n_components; ++c){
+        r[c] = component_size(components[c]);
+        dense[c] = use_dense_counts(model, r[c]);
+        if (dense[c]){
+            init_extractor(extractors[c], components[c]);
+            dense_counts[c].assign((size_t) 1 << (r[c] * model.n_ints), 0);
+        }
+        else{
+            reset_table(tables[c], model.n_ints);
+        }
+    }
+
+    // Loop over the blocks of the dataset
+    std::vector<__uint128_t> state(model.n_ints);
+    for (int begin = 0; begin < data.n_states; begin += evidence_block_size){
+        int end = std::min(begin + evidence_block_size, data.n_states);
+        // Count the states of every component in the block
+        for (int c = 0; c < n_components; ++c){
+            for (int j = begin; j < end; ++j){
+                const __uint128_t* obs = data.states + (size_t) j * model.n_ints;
+                if (dense[c]){
+                    uint32_t index = 0;
+                    for (int i = 0; i < model.n_ints; ++i){
+                        index |= extract_bits(extractors[c], obs[i]) << (i * r[c]);
+                    }
+                    dense_counts[c][index] += data.weights[j];
+                }
+                else{
+                    for (int i = 0; i < model.n_ints; ++i){
+                        state[i] = obs[i] & components[c];
+                    }
+                    add_to_table(tables[c], state.data(), data.weights[j]);
+                }
+            }
+        }
+    }
+
+    // Contributions from the different states
+    log_evidence.assign(n_components, 0);
+    for (int c = 0; c < n_components; ++c){
+        if (dense[c]){
+            count_histogram histogram;
+            for (unsigned int count : dense_counts[c]){
+                if (count){
+                    add_count(histogram, count, model);
+                }
+            }
+            log_evidence[c] = histogram_evidence(histogram, model) + evidence_prefactor(r[c], model);
+        }
+        else{
+            log_evidence[c] = evidence_from_table(tables[c], r[c], model);
+        }
+    }
+}
+
+/**
+ * Calculates the log evidence of a list of components in parallel and stores the ones that were not calculated yet.
+ * 
+ * @param[in] components        Vector of integers representing the components (may contain duplicates).
+ * @param[in, out] model        Struct containing the characteristic of the model.
+ *                              -'evidence_storage' ('evidence_storage_es' for the exhaustive search) will contain the log evidence of the components.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void get_evidence_batch(const std::vector<__uint128_t>& components, mcm& model){
+    if (!model.exhaustive){
+        get_evidence_batch(components, model, model.evidence_storage, true);
+        return;
+    }
+    std::vector<__uint128_t> missing;
+    for (__uint128_t component : components){
+        if (model.evidence_storage_es[component-1] == 0){
+            missing.push_back(component);
+        }
+    }
+    std::sort(missing.begin(), missing.end());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+    parallel_for(missing.size(), [&](int i){
+        model.evidence_storage_es[missing[i]-1] = calc_evidence_icc(missing[i], model, component_size(missing[i]));
+    });
+}
+
+/**
+ * Calculates the log evidence of all 2^n - 1 components in parallel and stores them for the exhaustive search algorithms.
+ * 
+ * @param[in, out] model        Struct containing the characteristic of the model.
+ *                              -'evidence_storage_es' will contain the log evidence of every component (index component-1).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void calc_all_evidence_icc(mcm& model){
+    model.exhaustive = true;
+    __uint128_t n_iccs = (__uint128_t) 1 << model.n;
+    model.evidence_storage_es.assign(n_iccs-1, 0);
+    int n_blocks = std::min((__uint128_t) 4096, n_iccs - 1);
+    parallel_for(n_blocks, [&](int block){
+        for (__uint128_t component = 1 + block; component < n_iccs; component += n_blocks){
+            model.evidence_storage_es[component-1] = calc_evidence_icc(component, model, component_size(component));
+        }
+    });
+}
+
 /**
  * Calculates the log evidence of a given component.
  * 
@@ -74,25 +542,46 @@ double get_evidence_icc(__uint128_t component, mcm& model){
  * @return Log evidence of the component
  */
 double calc_evidence_icc(__uint128_t component, mcm& model, int r){
-    double log_evidence = 0;
     // Contributions from the different observations
-    std::map<std::vector<__uint128_t>, unsigned int> counts = count_observations(model, component);
-    std::map<std::vector<__uint128_t>, unsigned int>::iterator count_iter = counts.begin();
-    while (count_iter != counts.end()){
-        log_evidence += (lgamma(count_iter->second + 0.5) - 0.5 * log(M_PI));
-        ++count_iter;
+    count_histogram histogram;
+    if (use_sliced_counts(model, r)){
+        // Small component (q = 2) -> AND and popcount over the bit-sliced view
+        static thread_local std::vector<uint64_t> sliced_counts;
+        count_observations_sliced(*model.data.slices, component, r, sliced_counts);
+        for (uint64_t count : sliced_counts){
+            if (count){
+                add_count(histogram, count, model);
+            }
+        }
     }
-
-    // Calculate prefactor
-    if (r > 25){
-        // Approximate for large components because lgamma overflows
-        log_evidence -= (r * log(model.q) * model.N);
+    else if (use_dense_counts(model, r)){
+        // Small component -> count in a dense array (one per thread, reused for every call)
+        static thread_local std::vector<unsigned int> dense_counts;
+        count_observations_dense(model, component, r, dense_counts);
+        size_t n_cells = (size_t) 1 << (r * model.n_ints);
+        for (size_t i = 0; i < n_cells; ++i){
+            if (dense_counts[i]){
+                add_count(histogram, dense_counts[i], model);
+                // Leave the array empty for the next call
+                dense_counts[i] = 0;
+            }
+        }
+    }
+    else if (use_parallel_counts(model)){
+        // Large dataset -> count the shards of the dataset in parallel
+        std::vector<count_table> parts;
+        count_observations_parallel(model, component, parts);
+        return evidence_from_parts(parts, r, model);
     }
     else{
-        log_evidence += lgamma(model.pow_q[r]/2.) - lgamma(model.N + model.pow_q[r]/2.);
+        // Counting table that is reused for every call (one per thread) -> no allocations once it has grown large enough
+        static thread_local count_table counts;
+        count_observations(model, component, counts);
+        return evidence_from_table(counts, r, model);
     }
-    
-    return log_evidence;
+
+    // Calculate prefactor
+    return histogram_evidence(histogram, model) + evidence_prefactor(r, model);
 }
 
 /**
@@ -115,3 +604,269 @@ double calc_evidence(std::vector<__uint128_t>& partition, mcm& model){
     }
     return log_evidence;
 }
+
+/**
+ * Precomputes the terms of the log evidence for the current dataset: the log gamma terms of the counts and the prefactors of all component sizes.
+ * 
+ * @param[in, out] model        Struct containing the characteristic of the model (N should be set).
+ *                              -'log_gamma' will contain lgamma(k + 1/2) - log(pi)/2 for k = 0 to min(N, max_log_gamma_counts).
+ *                              -'prefactors' will contain the prefactor of every component size from 0 to n.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void init_evidence_terms(mcm& model){
+    int n_counts = std::min(model.N, max_log_gamma_counts) + 1;
+    model.log_gamma.resize(n_counts);
+    for (int k = 0; k < n_counts; ++k){
+        model.log_gamma[k] = lgamma(k + 0.5) - 0.5 * log(M_PI);
+    }
+    model.prefactors.resize(model.n + 1);
+    for (int r = 0; r <= model.n; ++r){
+        model.prefactors[r] = calc_prefactor(r, model);
+    }
+}
+
+/**
+ * Calculates the part of the log evidence of a component that only depends on its size.
+ * 
+ * @param r                     Size of the component.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return The prefactor of the log evidence.
+ */
+double calc_prefactor(int r, mcm& model){
+    if (r > 25){
+        // Approximate for large components because lgamma overflows
+        return -(r * log(model.q) * model.N);
+    }
+    return lgamma(model.pow_q[r]/2.) - lgamma(model.N + model.pow_q[r]/2.);
+}
+
+/**
+ * Returns the part of the log evidence of a component that only depends on its size.
+ * 
+ * @param r                     Size of the component.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return The prefactor of the log evidence (precomputed, or calculated if the terms are not initialized for the dataset).
+ */
+double evidence_prefactor(int r, mcm& model){
+    if ((size_t) r < model.prefactors.size()){
+        return model.prefactors[r];
+    }
+    return calc_prefactor(r, model);
+}
+
+/**
+ * Calculates the log evidence of a component from its counting table.
+ * 
+ * @param[in] counts            Counting table of the component.
+ * @param r                     Size of the component.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return Log evidence of the component
+ */
+double evidence_from_table(const count_table& counts, int r, mcm& model){
+    count_histogram histogram;
+    for (unsigned int slot : counts.occupied){
+        add_count(histogram, counts.counts[slot], model);
+    }
+    return histogram_evidence(histogram, model) + evidence_prefactor(r, model);
+}
+
+/**
+ * Calculates the log evidence of a component from the counting tables of the parts of its state space.
+ * 
+ * @param[in] parts             Counting tables of the parts of the state space of the component.
+ * @param r                     Size of the component.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return Log evidence of the component
+ */
+double evidence_from_parts(const std::vector<count_table>& parts, int r, mcm& model){
+    count_histogram histogram;
+    for (const count_table& part : parts){
+        for (unsigned int slot : part.occupied){
+            add_count(histogram, part.counts[slot], model);
+        }
+    }
+    return histogram_evidence(histogram, model) + evidence_prefactor(r, model);
+}
+
+/**
+ * Assigns to every state in the dataset the index of its state in a given component.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param component             Integer representation of the bitstring representing a component.
+ * @param[in, out] labels       Vector that will contain the label of every state in the dataset (from 0 to the number of different states of the component - 1).
+ * 
+ * @return The number of different states of the component.
+ */
+int label_observations(mcm& model, __uint128_t component, std::vector<unsigned int>& labels){
+    const dataset& data = model.data;
+    labels.resize(data.n_states);
+    // The count of a state in the table is its label + 1
+    count_table table;
+    reset_table(table, model.n_ints);
+    std::vector<__uint128_t> state(model.n_ints);
+    for (int j = 0; j < data.n_states; ++j){
+        const __uint128_t* obs = data.states + (size_t) j * model.n_ints;
+        for (int i = 0; i < model.n_ints; ++i){
+            state[i] = obs[i] & component;
+        }
+        unsigned int label = table_count(table, state.data());
+        if (label == 0){
+            add_to_table(table, state.data(), table.occupied.size() + 1);
+            label = table.occupied.size();
+        }
+        labels[j] = label - 1;
+    }
+    return table.occupied.size();
+}
+
+/**
+ * Calculates the log evidence of a component extended with one variable from the labels of the states of the component.
+ * 
+ * Every state is counted in a dense array indexed by its label and the value of the new variable,
+ * so the states of the extended component do not have to be hashed.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param[in] labels            Label of every state in the dataset for the component (see label_observations).
+ * @param n_labels              Number of different labels.
+ * @param member                Integer representation of the bitstring with the variable that is added.
+ * @param r                     Size of the extended component.
+ * 
+ * @return Log evidence of the extended component
+ */
+double evidence_of_extension(mcm& model, const std::vector<unsigned int>& labels, int n_labels, __uint128_t member, int r){
+    // Dense array with one cell for every combination of a label and a value of the variable (one per thread, reused for every call)
+    static thread_local std::vector<unsigned int> cells;
+    int n_values = 1 << model.n_ints;
+    size_t n_cells = (size_t) n_labels * n_values;
+    if (cells.size() < n_cells){
+        cells.resize(n_cells, 0);
+    }
+    const dataset& data = model.data;
+    for (int j = 0; j < data.n_states; ++j){
+        const __uint128_t* obs = data.states + (size_t) j * model.n_ints;
+        // Value of the variable: its bit in every plane
+        int value = 0;
+        for (int i = 0; i < model.n_ints; ++i){
+            value |= ((obs[i] & member) != 0) << i;
+        }
+        cells[(size_t) labels[j] * n_values + value] += data.weights[j];
+    }
+    count_histogram histogram;
+    for (size_t i = 0; i < n_cells; ++i){
+        if (cells[i]){
+            add_count(histogram, cells[i], model);
+            // Leave the array empty for the next call
+            cells[i] = 0;
+        }
+    }
+    return histogram_evidence(histogram, model) + evidence_prefactor(r, model);
+}
+
+/**
+ * Labels every state in the dataset with its state in a component.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param component             Integer representation of the bitstring representing a component.
+ * @param[in, out] result       Labels of the component (for a single variable, n_labels also counts values that do not occur).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void init_labels(mcm& model, __uint128_t component, component_labels& result){
+    result.component = component;
+    if (component_size(component) > 1){
+        result.n_labels = label_observations(model, component, result.labels);
+        return;
+    }
+    // Single variable -> the label is its value (bits in every plane), which does not need a table
+    const dataset& data = model.data;
+    result.n_labels = 1 << model.n_ints;
+    result.labels.resize(data.n_states);
+    for (int j = 0; j < data.n_states; ++j){
+        const __uint128_t* obs = data.states + (size_t) j * model.n_ints;
+        unsigned int value = 0;
+        for (int i = 0; i < model.n_ints; ++i){
+            value |= ((obs[i] & component) != 0) << i;
+        }
+        result.labels[j] = value;
+    }
+}
+
+/**
+ * Calculates the log evidence of the union of two disjoint components from their labels.
+ * 
+ * The state of the union is the pair of labels, so a pass over the labels with a small join table replaces the extraction and hashing of the states.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param[in] labels_1          Labels of the first component.
+ * @param[in] labels_2          Labels of the second component.
+ * @param[in, out] joined       Labels of the union (only calculated if not nullptr).
+ * 
+ * @return Log evidence of the union of the components
+ */
+double evidence_of_join(mcm& model, const component_labels& labels_1, const component_labels& labels_2, component_labels* joined){
+    const dataset& data = model.data;
+    int r = component_size(labels_1.component | labels_2.component);
+    size_t n_pairs = (size_t) labels_1.n_labels * labels_2.n_labels;
+    if (n_pairs <= 4 * (size_t) data.n_states + 65536){
+        // Few pairs of labels -> dense join table (one per thread, reused for every call)
+        static thread_local std::vector<unsigned int> cells;
+        if (cells.size() < n_pairs){
+            cells.resize(n_pairs, 0);
+        }
+        for (int j = 0; j < data.n_states; ++j){
+            cells[(size_t) labels_1.labels[j] * labels_2.n_labels + labels_2.labels[j]] += data.weights[j];
+        }
+        std::vector<unsigned int> index(joined ? n_pairs : 0);
+        int n_labels = 0;
+        count_histogram histogram;
+        for (size_t i = 0; i < n_pairs; ++i){
+            if (cells[i]){
+                add_count(histogram, cells[i], model);
+                if (joined){
+                    index[i] = n_labels++;
+                }
+                // Leave the array empty for the next call
+                cells[i] = 0;
+            }
+        }
+        if (joined){
+            // The label of a pair is the number of occurring pairs before it
+            joined->component = labels_1.component | labels_2.component;
+            joined->n_labels = n_labels;
+            joined->labels.resize(data.n_states);
+            for (int j = 0; j < data.n_states; ++j){
+                joined->labels[j] = index[(size_t) labels_1.labels[j] * labels_2.n_labels + labels_2.labels[j]];
+            }
+        }
+        return histogram_evidence(histogram, model) + evidence_prefactor(r, model);
+    }
+
+    // Join table with the pairs of labels as keys
+    static thread_local count_table join;
+    reset_table(join, 1);
+    __uint128_t key;
+    for (int j = 0; j < data.n_states; ++j){
+        key = ((__uint128_t) labels_1.labels[j] << 32) | labels_2.labels[j];
+        add_to_table(join, &key, data.weights[j]);
+    }
+    if (joined){
+        // The label of a pair is its index in the order of insertion
+        std::vector<unsigned int> index(join.mask + 1);
+        for (size_t k = 0; k < join.occupied.size(); ++k){
+            index[join.occupied[k]] = k;
+        }
+        joined->component = labels_1.component | labels_2.component;
+        joined->n_labels = join.occupied.size();
+        joined->labels.resize(data.n_states);
+        for (int j = 0; j < data.n_states; ++j){
+            key = ((__uint128_t) labels_1.labels[j] << 32) | labels_2.labels[j];
+            joined->labels[j] = index[find_slot(join, &key)];
+        }
+    }
+    return evidence_from_table(join, r, model);
+}
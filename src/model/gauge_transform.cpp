@@ -18,7 +18,7 @@ int gcd(int a, int b){
 /**
  * Perform a gauge transformation of a single state.
  * 
- * @param[in, out] state        A state represented as n_ints 128bit integers.
+ * @param[in, out] state        Pointer to a state represented as n_ints 128bit integers.
  * @param[in] gt                Vector of operators represented as n_ints 128bit integers that form the new basis variables.
  * @param q                     Number of values a single variable can take.
  * @param n                     Number of variables in the system.
@@ -26,20 +26,34 @@ int gcd(int a, int b){
  * 
  * @return void                 Nothing is returned by this function 
  */
-void gt_state(std::vector<__uint128_t>& state, std::vector<std::vector<__uint128_t>>& gt, int q, int n, int n_ints){
-    // Variable for transformed state
-    std::vector<int> new_state(n);
+void gt_state(__uint128_t* state, std::vector<std::vector<__uint128_t>>& gt, int q, int n, int n_ints){
+    // Variable for transformed state (the original state is needed until all new variables are determined)
+    __uint128_t new_state[n_ints];
+    std::fill(new_state, new_state + n_ints, 0);
+    __uint128_t element = 1;
     for (int i = 0; i < n; ++i){
         // Determine the spin value for each new variable
-        new_state[i] = spin_value(state, gt[i], q, n_ints);
+        int value = spin_value(state, gt[i].data(), q, n_ints);
+        int bit = 0;
+        while (value){
+            // Check if last bit in the binary representation is nonzero
+            if (value & 1){
+                new_state[bit] += element;
+            }
+            ++bit;
+            value >>= 1;
+        }
+        // Bitshift to the left to get the integer value of the next variable
+        element <<= 1;
     }
-    state = convert_representation(new_state, n, n_ints);
+    std::copy(new_state, new_state + n_ints, state);
 }
 
 /**
  * Perform a gauge transformation of the entire dataset.
  * 
- * @param[in, out] data         Dataset containing all observations represented as n_ints 128bit integers.
+ * @param[in, out] data         Dataset containing all different states represented as n_ints 128bit integers
+ *                              (the transformation is a bijection, so the states remain different and their weights are unchanged).
  * @param[in] gt                Vector of operators represented as n_ints 128bit integers that form the new basis variables.
  * @param q                     Number of values a single variable can take.
  * @param n                     Number of variables in the system.
@@ -47,13 +61,204 @@ void gt_state(std::vector<__uint128_t>& state, std::vector<std::vector<__uint128
  * 
  * @return void                 Nothing is returned by this function 
  */
-void transform_data(std::vector<std::vector<__uint128_t>>& data, std::vector<std::vector<__uint128_t>>& gt, int q, int n, int n_ints){
-    // Loop over all observations and perform a gauge transformation on each observation
-    for (std::vector<__uint128_t>& obs : data){
-        gt_state(obs, gt, q, n, n_ints);
+void transform_data(dataset& data, std::vector<std::vector<__uint128_t>>& gt, int q, int n, int n_ints){
+    // Loop over all states and perform a gauge transformation on each state
+    for (int i = 0; i < data.n_states; ++i){
+        gt_state(data.states + (size_t) i * n_ints, gt, q, n, n_ints);
+    }
+    // Keep the bit-sliced view consistent with the transformed states
+    if (data.slices){
+        build_bit_slices(data, n);
+    }
+}
+
+/**
+ * Determines if the entropy of the operators should be obtained from the Fourier spectrum of the state distribution.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param max_order             Maximum interaction order of the operators that are considered (0 for all operators).
+ * 
+ * @return True if the spectrum of all q^n states fits in memory and is cheaper than a scan of the data for every operator.
+ */
+bool use_spectrum(mcm& model, unsigned int max_order){
+    if (max_order == 0 || max_order > (unsigned int) model.n){
+        max_order = model.n;
+    }
+    // Memory: one integer (q = 2) or one complex number (q > 2) per state
+    double n_cells = pow(model.q, model.n);
+    double bytes_per_cell = (model.q == 2) ? sizeof(int64_t) : sizeof(std::complex<double>);
+    if (n_cells * bytes_per_cell > max_spectrum_bytes){
+        return false;
+    }
+    // Number of operators with an interaction order up to max_order
+    double n_ops = 0;
+    double binomial = 1;
+    for (unsigned int k = 1; k <= max_order; ++k){
+        binomial = binomial * (model.n - k + 1) / k;
+        n_ops += binomial * pow(model.q - 1, k);
+    }
+    // Cost of the transform compared to the cost of one scan of the data per operator
+    double transform_cost = n_cells * model.n * model.q;
+    double scan_cost = n_ops * model.data.n_states;
+    return transform_cost < scan_cost;
+}
+
+/**
+ * In-place fast Walsh-Hadamard transform.
+ * 
+ * @param[in, out] f            Vector of size 2^n, will contain F(a) = sum_s f(s) (-1)^(a.s).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void walsh_hadamard_transform(std::vector<int64_t>& f){
+    size_t size = f.size();
+    for (size_t half = 1; half < size; half <<= 1){
+        for (size_t start = 0; start < size; start += 2 * half){
+            for (size_t i = start; i < start + half; ++i){
+                int64_t x = f[i];
+                int64_t y = f[i + half];
+                f[i] = x + y;
+                f[i + half] = x - y;
+            }
+        }
+    }
+}
+
+/**
+ * In-place q-ary Fourier transform over the n-dimensional space of states.
+ * 
+ * @param[in, out] f            Vector of size q^n (state s has index sum_i s_i q^i), will contain F(b) = sum_s f(s) w^(b.s) with w = exp(2 pi i / q).
+ * @param q                     Number of values a single variable can take.
+ * @param n                     Number of variables in the system.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void fourier_transform_q(std::vector<std::complex<double>>& f, int q, int n){
+    // Powers of the qth root of unity
+    std::vector<std::complex<double>> roots(q);
+    for (int k = 0; k < q; ++k){
+        roots[k] = std::polar(1.0, 2 * M_PI * k / q);
+    }
+    std::vector<std::complex<double>> line(q);
+    size_t size = f.size();
+    size_t stride = 1;
+    // Discrete Fourier transform of length q along every dimension
+    for (int dim = 0; dim < n; ++dim){
+        for (size_t start = 0; start < size; start += stride * q){
+            for (size_t offset = start; offset < start + stride; ++offset){
+                for (int b = 0; b < q; ++b){
+                    line[b] = 0;
+                    for (int s = 0; s < q; ++s){
+                        line[b] += f[offset + s * stride] * roots[(b * s) % q];
+                    }
+                }
+                for (int b = 0; b < q; ++b){
+                    f[offset + b * stride] = line[b];
+                }
+            }
+        }
+        stride *= q;
+    }
+}
+
+/**
+ * Calculates the Fourier spectrum of the distribution of the states in the dataset.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param[in, out] spectrum     Struct that will contain the transform of the histogram of the q^n states.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void build_spectrum(mcm& model, operator_spectrum& spectrum){
+    spectrum.q = model.q;
+    spectrum.n = model.n;
+    spectrum.N = model.N;
+    size_t n_cells = pow(model.q, model.n) + 0.5;
+    spectrum.walsh.clear();
+    spectrum.fourier.clear();
+    if (model.q == 2){
+        spectrum.walsh.assign(n_cells, 0);
+    }
+    else{
+        spectrum.fourier.assign(n_cells, 0);
+    }
+    // Histogram of the states
+    for (int i = 0; i < model.data.n_states; ++i){
+        const __uint128_t* state = model.data.states + (size_t) i * model.n_ints;
+        size_t index = 0;
+        size_t power = 1;
+        for (int j = 0; j < model.n; ++j){
+            int value = 0;
+            for (int k = 0; k < model.n_ints; ++k){
+                value |= ((state[k] >> j) & 1) << k;
+            }
+            index += value * power;
+            power *= model.q;
+        }
+        if (model.q == 2){
+            spectrum.walsh[index] += model.data.weights[i];
+        }
+        else{
+            spectrum.fourier[index] += (double) model.data.weights[i];
+        }
+    }
+    if (model.q == 2){
+        walsh_hadamard_transform(spectrum.walsh);
+    }
+    else{
+        fourier_transform_q(spectrum.fourier, model.q, model.n);
     }
 }
 
+/**
+ * Calculates the entropy of a spin operator from the Fourier spectrum of the state distribution.
+ * 
+ * @param[in] spectrum          Struct containing the transform of the histogram of the states.
+ * @param[in] a                 Operator as a vector with n values between 0 and q-1.
+ * 
+ * @return The entropy of the operator.
+ */
+double entropy_from_spectrum(operator_spectrum& spectrum, std::vector<int>& a){
+    int q = spectrum.q;
+    std::vector<double> prob_distr(q, 0);
+    if (q == 2){
+        // F(a) = N(0) - N(1)
+        size_t index = 0;
+        for (int j = 0; j < spectrum.n; ++j){
+            index |= (size_t) a[j] << j;
+        }
+        int64_t count_1 = (spectrum.N - spectrum.walsh[index]) / 2;
+        prob_distr[0] = spectrum.N - count_1;
+        prob_distr[1] = count_1;
+    }
+    else{
+        // N(k) = 1/q sum_j w^(-jk) F(j a)
+        std::vector<std::complex<double>> values(q);
+        for (int j = 0; j < q; ++j){
+            size_t index = 0;
+            size_t power = 1;
+            for (int i = 0; i < spectrum.n; ++i){
+                index += ((j * a[i]) % q) * power;
+                power *= q;
+            }
+            values[j] = spectrum.fourier[index];
+        }
+        for (int k = 0; k < q; ++k){
+            std::complex<double> count = 0;
+            for (int j = 0; j < q; ++j){
+                count += values[j] * std::polar(1.0, -2 * M_PI * ((j * k) % q) / q);
+            }
+            // The counts are integers -> rounding removes the numerical error of the transform
+            prob_distr[k] = round(count.real() / q);
+        }
+    }
+    // Normalize the distribution
+    for (int k = 0; k < q; ++k){
+        prob_distr[k] /= spectrum.N;
+    }
+    return entropy(prob_distr);
+}
+
 /**
  * Sorts spin operators from low to high entropy.
  * 
@@ -83,6 +288,14 @@ void sort_operators(mcm& model, std::vector<std::vector<int>>& sorted_ops, unsig
     int order = 0;
     int leading_bit = 0;
     std::vector<__uint128_t> op;
+
+    // For small systems, the entropy of all operators follows from one Fourier transform of the state distribution
+    bool spectral = use_spectrum(model, max_order);
+    operator_spectrum spectrum;
+    if (spectral){
+        build_spectrum(model, spectrum);
+    }
+
     while (!all_ops_generated){
         // Increase first bit
         a[0] += 1;
@@ -130,8 +343,13 @@ void sort_operators(mcm& model, std::vector<std::vector<int>>& sorted_ops, unsig
                 // Store the representation with n values between 0 and q-1 because these will be the columns of the matrix
                 entropy.first = a;
                 // Calculate the entropy
-                op = convert_representation(a, model.n, model.n_ints);
-                entropy.second = entropy_of_op(model.data, op, model.q, model.n_ints);
+                if (spectral){
+                    entropy.second = entropy_from_spectrum(spectrum, a);
+                }
+                else{
+                    op = convert_representation(a, model.n, model.n_ints);
+                    entropy.second = entropy_of_op(model.data, op, model.q, model.n_ints);
+                }
                 entropy_of_ops.push_back(entropy);
             }
         }
@@ -11,6 +11,274 @@
 #include <bitset>
 #include <cmath>
 #include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <functional>
+#include <complex>
+#include <deque>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
+/**
+ * Open-addressing hash table to count the occurrences of the states of a component
+ * 
+ * @struct count_table
+ * 
+ * @var count_table::n_ints
+ *  Number of 128bit integers in a key
+ * 
+ * @var count_table::mask
+ *  Number of slots minus one (the number of slots is a power of 2)
+ * 
+ * @var count_table::keys
+ *  Keys of all slots stored inline (n_ints integers per slot)
+ * 
+ * @var count_table::counts
+ *  Count of the key in every slot (zero for an empty slot)
+ * 
+ * @var count_table::occupied
+ *  Indices of the occupied slots in order of insertion
+ */
+struct count_table {
+    int n_ints = 0;
+    unsigned int mask = 0;
+    std::vector<__uint128_t> keys;
+    std::vector<unsigned int> counts;
+    // Iterating over the occupied slots (instead of all slots) and clearing only those keeps a reused table cheap
+    std::vector<unsigned int> occupied;
+};
+
+/**
+ * Bounded cache of the counting tables of components, from which the counts of their subsets are derived
+ * 
+ * @struct count_cache
+ * 
+ * @var count_cache::max_keys
+ *  Largest total number of states in the cached tables
+ * 
+ * @var count_cache::n_keys
+ *  Total number of states in the cached tables
+ * 
+ * @var count_cache::tables
+ *  Counting table of every cached component
+ * 
+ * @var count_cache::order
+ *  Cached components in order of insertion (the oldest one is removed first)
+ * 
+ * @var count_cache::containing
+ *  Cached components that contain a given variable (one list per variable)
+ */
+struct count_cache {
+    size_t max_keys = (size_t) 1 << 22;
+    size_t n_keys = 0;
+    std::map<__uint128_t, count_table> tables;
+    std::deque<__uint128_t> order;
+    // A superset contains every variable of the component -> only the shortest list of its variables has to be checked
+    std::vector<std::vector<__uint128_t>> containing;
+};
+
+/**
+ * Label of every state in the dataset for the state it has in a component
+ * 
+ * @struct component_labels
+ * 
+ * @var component_labels::component
+ *  Integer representation of the bitstring representing the component
+ * 
+ * @var component_labels::n_labels
+ *  Number of different states of the component
+ * 
+ * @var component_labels::labels
+ *  Label of every state in the dataset (from 0 to n_labels-1)
+ */
+struct component_labels {
+    __uint128_t component = 0;
+    int n_labels = 0;
+    std::vector<unsigned int> labels;
+};
+
+/**
+ * Parallel bit extraction (PEXT) of the bits of a component from a 128bit integer
+ * 
+ * @struct bit_extractor
+ * 
+ * @var bit_extractor::component
+ *  Integer representation of the bitstring representing the component
+ * 
+ * @var bit_extractor::n_bytes
+ *  Number of bytes of the component that contain at least one bit set to 1
+ * 
+ * @var bit_extractor::byte_index
+ *  Index of these bytes in the 128bit integer
+ * 
+ * @var bit_extractor::shift
+ *  Number of bits of the component in the bytes below each of these bytes
+ * 
+ * @var bit_extractor::lut
+ *  Lookup table with the packed bits of the component for each of the 256 values of each of these bytes
+ */
+struct bit_extractor {
+    __uint128_t component;
+    int n_bytes;
+    int byte_index[16];
+    int shift[16];
+    // Only used if the BMI2 instruction set is not available
+    uint8_t lut[16][256];
+};
+
+/**
+ * Column-major bit-sliced view on a dataset
+ * 
+ * @struct bit_slices
+ * 
+ * @var bit_slices::n
+ *  Number of variables
+ * 
+ * @var bit_slices::n_ints
+ *  Number of planes (128bit integers per state)
+ * 
+ * @var bit_slices::n_words
+ *  Number of 64bit words in a bitset over all states
+ * 
+ * @var bit_slices::n_weight_planes
+ *  Number of bits necessary to represent the largest weight
+ * 
+ * @var bit_slices::columns
+ *  For every variable and plane, the bitset of the states with that bit set to 1
+ * 
+ * @var bit_slices::weight_planes
+ *  For every bit of the weights, the bitset of the states with that bit set to 1
+ */
+struct bit_slices {
+    int n;
+    int n_ints;
+    int n_words;
+    int n_weight_planes;
+    // Bitset of variable j in plane k starts at index (j * n_ints + k) * n_words
+    std::vector<uint64_t> columns;
+    // Weighted counts are sums over the weight bits: sum_b 2^b * popcount(selection & weight_plane_b)
+    std::vector<uint64_t> weight_planes;
+};
+
+/**
+ * View on a dataset stored in one contiguous, 64-byte aligned buffer
+ * 
+ * @struct dataset
+ * 
+ * @var dataset::n_states
+ *  Number of states in the dataset
+ * 
+ * @var dataset::n_ints
+ *  Number of 128bit integers necessary to represent a state
+ * 
+ * @var dataset::states
+ *  The states stored row by row (state i occupies the n_ints integers starting at states[i * n_ints])
+ * 
+ * @var dataset::weights
+ *  Number of occurrences of each state
+ * 
+ * @var dataset::memory
+ *  Owner of the buffer that contains the states and the weights (shared by all copies of the view)
+ * 
+ * @var dataset::slices
+ *  Optional column-major bit-sliced view on the same states (empty if it is not built)
+ */
+struct dataset {
+    int n_states = 0;
+    int n_ints = 0;
+    __uint128_t* states = nullptr;
+    unsigned int* weights = nullptr;
+    std::shared_ptr<void> memory;
+    std::shared_ptr<bit_slices> slices;
+};
+
+/**
+ * Fourier spectrum of the distribution of the states, which gives the distribution of every spin operator
+ * 
+ * @struct operator_spectrum
+ * 
+ * @var operator_spectrum::q
+ *  Number of values a single variable can take
+ * 
+ * @var operator_spectrum::n
+ *  Number of variables in the system
+ * 
+ * @var operator_spectrum::N
+ *  Number of observations in the dataset
+ * 
+ * @var operator_spectrum::walsh
+ *  Walsh-Hadamard transform of the histogram of the 2^n states (q = 2)
+ * 
+ * @var operator_spectrum::fourier
+ *  q-ary Fourier transform of the histogram of the q^n states (q > 2)
+ */
+struct operator_spectrum {
+    int q;
+    int n;
+    int64_t N;
+    std::vector<int64_t> walsh;
+    std::vector<std::complex<double>> fourier;
+};
+
+// Largest number of states of a component that is counted with the bit-sliced view (fewer popcounts than states in a word)
+const int max_sliced_cells = 32;
+// Largest size of a component that is counted with the bit-sliced view (2^5 = max_sliced_cells)
+const int max_sliced_size = 5;
+// Number of states in a block of the dataset when several components are counted in one pass (stays in the cache of the processor)
+const int evidence_block_size = 2048;
+// Largest number of components that are counted in one pass over the dataset
+const int max_group_size = 16;
+// Number of different states in the dataset from which large components are counted in parallel over shards of the dataset
+const int min_parallel_states = 1 << 18;
+// Smallest number of states in a shard of the dataset when counting in parallel
+const int min_shard_states = 1 << 16;
+// Number of parts of the state space that are merged in parallel after counting the shards (power of 2)
+const int n_count_parts = 64;
+// Counts below this value are accumulated in a histogram before their log gamma terms are added
+const int n_small_counts = 256;
+// Largest count with a precomputed log gamma term (8MB)
+const int max_log_gamma_counts = 1 << 20;
+// Largest amount of memory used for the labels of the components in the greedy search (1GB)
+const double max_label_bytes = 1073741824.;
+// Largest amount of memory used for the spectrum of the state distribution (512MB)
+const double max_spectrum_bytes = 536870912.;
+
+/**
+ * Histogram with a fixed bin width of the log evidence of all partitions
+ * 
+ * @struct evidence_histogram
+ * 
+ * @var evidence_histogram::width
+ *  Width of a bin (0 if no histogram is made)
+ * 
+ * @var evidence_histogram::first_bin
+ *  Index of the first bin, bin b contains the values in [b * width, (b+1) * width)
+ * 
+ * @var evidence_histogram::counts
+ *  Number of values in every bin starting from the first bin
+ */
+struct evidence_histogram {
+    double width = 0;
+    int64_t first_bin = 0;
+    std::vector<uint64_t> counts;
+};
+
+/**
+ * Bounded list of the partitions with the largest log evidence
+ * 
+ * @struct top_partitions
+ * 
+ * @var top_partitions::k
+ *  Maximum number of partitions in the list (0 if no list is kept)
+ * 
+ * @var top_partitions::heap
+ *  Pairs of the log evidence and the partition, ordered as a heap with the worst partition at the front
+ */
+struct top_partitions {
+    size_t k = 0;
+    std::vector<std::pair<double, std::vector<__uint128_t>>> heap;
+};
 
 /**
  * Representation of the characteristics of a Minimally Complex Model
@@ -18,13 +286,13 @@
  * @struct mcm
  * 
  * @var mcm::data
- *  The dataset
+ *  The different states that occur in the dataset with the number of times each state occurs
  * 
  * @var mcm::n
  *  Number of variables in the system
  * 
  * @var mcm::N
- *  Number of observations in the dataset
+ *  Number of observations in the dataset (sum of the weights)
  * 
  * @var mcm::q
  *  Number of states
@@ -44,6 +312,16 @@
  * @var mcm::evidence_storage
  *  Map to store the calculated log evidence of components during non-exhaustive search algorithm
  * 
+ * @var mcm::log_gamma
+ *  Vector with the log gamma term lgamma(k + 1/2) - log(pi)/2 of a state with count k (k from 0 to min(N, max_log_gamma_counts)),
+ *  set by load_data and read_binary (init_evidence_terms should be called again when the data is changed in another way, larger counts use lgamma)
+ * 
+ * @var mcm::prefactors
+ *  Vector with the prefactor of the log evidence of a component of size r (r from 0 to n), set together with 'log_gamma' (calculated if it is empty)
+ * 
+ * @var mcm::table_cache
+ *  Counting tables of components from which the counts of their subsets are derived (non-exhaustive search algorithms)
+ * 
  * @var mcm::best_basis
  *  Vector containing n independent operators with the lowest entropy
  * 
@@ -62,14 +340,30 @@
  * @var mcm::divide_and_conquer_file
  *  Filename for the intermediate steps of the divide and conquer procedure
  * 
- * @var mcm::store_all_ev
- *  Boolean to indicate if the log evidence of all partitions encounterd during the exhaustive search should be stored
+ * @var mcm::histogram
+ *  Histogram of the log evidence of all partitions encountered during the exhaustive search (only if the bin width is set)
+ * 
+ * @var mcm::top_mcm
+ *  The partitions with the largest log evidence encountered during the exhaustive search (only if the number of partitions is set)
+ * 
+ * @var mcm::checkpoint_file
+ *  File to which the progress of the exhaustive search is written (no checkpoints if empty)
+ * 
+ * @var mcm::checkpoint_interval
+ *  Minimum number of seconds between two checkpoints
  * 
- * @var mcm::all_evidences
- *  Vector with the log evidence of all partitions encounterd during the exhaustive search
+ * @var mcm::resume
+ *  Boolean to indicate if the exhaustive search should continue from the checkpoint file
+ * 
+ * @var mcm::shard
+ *  Index of the part of the partitions that is processed by the exhaustive search (0 to n_shards-1)
+ * 
+ * @var mcm::n_shards
+ *  Number of parts in which the partitions are divided (0 or 1 if the exhaustive search goes through all partitions)
  */
 struct mcm {
-    std::vector<std::vector<__uint128_t>> data;
+    // Every state is stored only once together with its multiplicity -> scans over the data go over the unique states
+    dataset data;
     int n;
     int N;
     int q;
@@ -85,6 +379,11 @@ struct mcm {
 
     // Store in map otherwise because not every ICC will occur (better memory efficiency)
     std::map<__uint128_t, double> evidence_storage;
+    // Terms of the log evidence precomputed for the dataset -> no lgamma in the loops over the states of a component
+    std::vector<double> log_gamma;
+    std::vector<double> prefactors;
+    // Counts of a component are derived from a cached superset instead of scanning the data again
+    count_cache table_cache;
 
     std::vector<std::vector<__uint128_t>> best_basis;
     // Store the best partition in a vector in case there are multiple partitions with the same log evidence
@@ -98,23 +397,100 @@ struct mcm {
     std::ofstream* greedy_file;
     std::ofstream* divide_and_conquer_file;
 
-    // Store evidence of all partitions (useful when creating distribution of the evidence of all partition during an analysis)
-    bool store_all_ev = false;
-    std::vector<double> all_evidence;
+    // Distribution of the evidence of all partitions (useful during an analysis), constant memory instead of storing all Bell(n) values
+    evidence_histogram histogram;
+    top_partitions top_mcm;
+
+    // Checkpoints to resume an interrupted exhaustive search
+    std::string checkpoint_file;
+    double checkpoint_interval = 600;
+    bool resume = false;
+
+    // Exhaustive search divided over several processes
+    int shard = 0;
+    int n_shards = 0;
 };
 
 // Function in model.cpp
 mcm create_model(int q, int n, bool log_file);
 
 // Functions in data.cpp
-std::vector<std::vector<__uint128_t>> data_processing(std::string file, int n, int n_ints);
-void convert_observation(std::vector<__uint128_t>& obs, std::string& raw_obs, int n);
+void allocate_dataset(dataset& data, int n_states, int n_ints);
+std::vector<__uint128_t> get_state(const dataset& data, int i);
+dataset data_processing(std::string file, int n, int n_ints, int q=0);
+bool convert_observation(__uint128_t* obs, const char* raw_obs, int n, int n_ints, int q=0);
+bool load_data(mcm& model, dataset& data);
+uint64_t data_checksum(const dataset& data);
+uint64_t binary_checksum(const dataset& data, uint64_t N);
+bool write_binary(std::string file, mcm& model);
+bool read_binary(std::string file, mcm& model);
+
+// Functions in parallel.cpp
+void set_num_threads(int n_threads);
+int get_num_threads();
+void parallel_for(int n_tasks, const std::function<void(int)>& task);
+
+// Functions in bit_slices.cpp
+void build_bit_slices(dataset& data, int n);
+const uint64_t* get_column(const bit_slices& slices, int variable, int plane);
+uint64_t weighted_popcount(const bit_slices& slices, uint64_t mask, int w);
+uint64_t count_parity(const bit_slices& slices, __uint128_t op);
+bool use_sliced_counts(mcm& model, int r);
+void count_observations_sliced(const bit_slices& slices, __uint128_t component, int r, std::vector<uint64_t>& counts);
+
+// Functions in count_table.cpp
+uint64_t hash_key(const __uint128_t* key, int n_ints);
+unsigned int find_slot(const count_table& table, const __uint128_t* key);
+void grow_table(count_table& table);
+void reset_table(count_table& table, int n_ints);
+void add_to_table(count_table& table, const __uint128_t* key, unsigned int weight);
+unsigned int table_count(const count_table& table, const __uint128_t* key);
+void marginalize_table(const count_table& table, __uint128_t removed, count_table& result);
+void add_table(count_table& table, const count_table& other);
+
+// Functions in count_cache.cpp
+bool counted_with_table(mcm& model, int r);
+std::map<__uint128_t, count_table>::const_iterator find_superset(const count_cache& cache, __uint128_t component);
+bool derive_from_cache(mcm& model, __uint128_t component, count_table& counts);
+void count_component(mcm& model, __uint128_t component, count_table& counts);
+bool worth_caching(mcm& model, const count_table& counts);
+void add_to_cache(count_cache& cache, __uint128_t component, count_table& counts);
+void clear_cache(count_cache& cache);
 
 // Function in evidence.cpp
-std::map<std::vector<__uint128_t>, unsigned int> count_observations(mcm& model, __uint128_t component);
+void count_observations(mcm& model, __uint128_t component, count_table& counts);
+bool use_parallel_counts(mcm& model);
+void count_observations_parallel(mcm& model, __uint128_t component, std::vector<count_table>& parts);
+void init_extractor(bit_extractor& extractor, __uint128_t component);
+uint32_t extract_bits(const bit_extractor& extractor, __uint128_t value);
+bool use_dense_counts(mcm& model, int r);
+void count_observations_dense(mcm& model, __uint128_t component, int r, std::vector<unsigned int>& counts);
 double get_evidence_icc(__uint128_t component, mcm& model);
+void get_evidence_batch(const std::vector<__uint128_t>& components, mcm& model, std::map<__uint128_t, double>& storage, bool fill_cache=false);
+void get_evidence_batch(const std::vector<__uint128_t>& components, mcm& model);
+void calc_evidence_group(mcm& model, const std::vector<__uint128_t>& components, std::vector<double>& log_evidence, std::vector<count_table>& tables);
+void calc_all_evidence_icc(mcm& model);
 double calc_evidence_icc(__uint128_t component, mcm& model, int r);
 double calc_evidence(std::vector<__uint128_t>& partition, mcm& model);
+void init_evidence_terms(mcm& model);
+double calc_prefactor(int r, mcm& model);
+double evidence_prefactor(int r, mcm& model);
+double evidence_from_table(const count_table& counts, int r, mcm& model);
+double evidence_from_parts(const std::vector<count_table>& parts, int r, mcm& model);
+int label_observations(mcm& model, __uint128_t component, std::vector<unsigned int>& labels);
+double evidence_of_extension(mcm& model, const std::vector<unsigned int>& labels, int n_labels, __uint128_t member, int r);
+void init_labels(mcm& model, __uint128_t component, component_labels& result);
+double evidence_of_join(mcm& model, const component_labels& labels_1, const component_labels& labels_2, component_labels* joined=nullptr);
+
+// Functions in statistics.cpp
+void add_to_histogram(evidence_histogram& histogram, double value);
+void add_to_bin(evidence_histogram& histogram, int64_t bin, uint64_t count);
+void merge_histograms(evidence_histogram& histogram, const evidence_histogram& other);
+bool comp_top(const std::pair<double, std::vector<__uint128_t>>& p1, const std::pair<double, std::vector<__uint128_t>>& p2);
+bool enters_top(const top_partitions& top, double log_evidence);
+void add_to_top(top_partitions& top, double log_evidence, const std::vector<__uint128_t>& partition);
+void merge_top(top_partitions& top, const top_partitions& other);
+std::vector<std::pair<double, std::vector<__uint128_t>>> sorted_top(const top_partitions& top);
 
 // Functions in partition.cpp
 std::string component_as_string(__uint128_t component, int n);
@@ -126,13 +502,18 @@ void print_partition_to_file(std::ofstream& file, std::vector<__uint128_t>& part
 // Functions in spin_op.cpp
 int count_set_bits(__uint128_t value);
 std::vector<__uint128_t> convert_representation(std::vector<int>& a, int n, int n_ints);
-int spin_value(std::vector<__uint128_t>& state, std::vector<__uint128_t>& op, int q, int n_ints);
+int spin_value(const __uint128_t* state, const __uint128_t* op, int q, int n_ints);
 double entropy(std::vector<double>& prob_distr);
-double entropy_of_op(std::vector<std::vector<__uint128_t>>& data, std::vector<__uint128_t>& op, int q, int n_ints);
+double entropy_of_op(dataset& data, std::vector<__uint128_t>& op, int q, int n_ints);
 
 // Functions in gauge_transform.cpp
-void gt_state(std::vector<__uint128_t>& state, std::vector<std::vector<__uint128_t>>& gt, int q, int n, int n_ints);
-void transform_data(std::vector<std::vector<__uint128_t>>& data, std::vector<std::vector<__uint128_t>>& gt, int q, int n, int n_ints);
+void gt_state(__uint128_t* state, std::vector<std::vector<__uint128_t>>& gt, int q, int n, int n_ints);
+void transform_data(dataset& data, std::vector<std::vector<__uint128_t>>& gt, int q, int n, int n_ints);
+bool use_spectrum(mcm& model, unsigned int max_order);
+void walsh_hadamard_transform(std::vector<int64_t>& f);
+void fourier_transform_q(std::vector<std::complex<double>>& f, int q, int n);
+void build_spectrum(mcm& model, operator_spectrum& spectrum);
+double entropy_from_spectrum(operator_spectrum& spectrum, std::vector<int>& a);
 void sort_operators(mcm& model, std::vector<std::vector<__uint128_t>>& sorted_ops, unsigned int max_order=0);
 bool comp_entropy(std::pair<std::vector<int>, double>& op1, std::pair<std::vector<int>, double>& op2);
 void construct_matrix(std::vector<std::vector<unsigned int>>& matrix, std::vector<std::vector<int>>& ops, __uint128_t n_ops, int q, int n);
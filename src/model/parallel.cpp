@@ -0,0 +1,243 @@
+#include "model.h"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+// Number of threads used by the parallel parts of the program (0 -> number of hardware threads)
+static int num_threads = 0;
+
+/**
+ * Sets the number of threads used by the parallel parts of the program.
+ * 
+ * @param n_threads             Number of threads, 0 to use all hardware threads.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void set_num_threads(int n_threads){
+    num_threads = std::max(n_threads, 0);
+}
+
+/**
+ * Returns the number of threads used by the parallel parts of the program.
+ * 
+ * @return The number of threads (at least 1).
+ */
+int get_num_threads(){
+    if (num_threads > 0){
+        return num_threads;
+    }
+    int n_hardware = std::thread::hardware_concurrency();
+    return std::max(n_hardware, 1);
+}
+
+/**
+ * Range of task indices that still have to be started, owned by one participant of a parallel loop.
+ */
+struct task_range {
+    std::mutex lock;
+    int begin = 0;
+    int end = 0;
+};
+
+/**
+ * Parallel loop that is being executed by the thread pool.
+ */
+struct parallel_job {
+    const std::function<void(int)>* task;
+    // One range per participant, other participants steal from it when their own range is empty
+    std::vector<task_range> ranges;
+    // Number of tasks that are not finished yet
+    std::atomic<int> remaining;
+    std::mutex done_lock;
+    std::condition_variable done;
+
+    parallel_job(int n_ranges) : ranges(n_ranges) {}
+};
+
+/**
+ * Persistent worker threads shared by all parallel loops.
+ */
+struct thread_pool {
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::vector<std::thread> threads;
+    // Jobs that may still have tasks that are not started yet (most recent at the back)
+    std::deque<std::shared_ptr<parallel_job>> jobs;
+    bool stop = false;
+
+    ~thread_pool(){
+        resize(0);
+    }
+
+    void resize(int n_workers);
+    void work(int slot);
+};
+
+static thread_pool pool;
+
+// Index of the range a thread starts with (0 for the threads that are not part of the pool)
+static thread_local int thread_slot = 0;
+// Number of parallel loops the thread is currently taking part in as caller
+static thread_local int nesting = 0;
+
+/**
+ * Claims and executes one task of a parallel loop.
+ * 
+ * A participant takes the first task of its own range.
+ * When its own range is empty, it steals the upper half of the range of another participant.
+ * 
+ * @param[in, out] job          Parallel loop.
+ * @param slot                  Index of the range of the participant.
+ * 
+ * @return True if a task was executed, false if all tasks are already started.
+ */
+bool run_task(parallel_job& job, int slot){
+    int n_ranges = job.ranges.size();
+    slot %= n_ranges;
+    int i = -1;
+    // Loop over the ranges starting with the own range
+    for (int k = 0; k < n_ranges && i < 0; ++k){
+        task_range& victim = job.ranges[(slot + k) % n_ranges];
+        std::unique_lock<std::mutex> victim_lock(victim.lock);
+        if (victim.begin >= victim.end){continue;}
+        if (k == 0){
+            i = victim.begin++;
+            continue;
+        }
+        // Steal the upper half of the range
+        int middle = victim.begin + (victim.end - victim.begin) / 2;
+        int end = victim.end;
+        victim.end = middle;
+        victim_lock.unlock();
+        i = middle;
+        if (middle + 1 < end){
+            task_range& own = job.ranges[slot];
+            std::lock_guard<std::mutex> own_lock(own.lock);
+            own.begin = middle + 1;
+            own.end = end;
+        }
+    }
+    if (i < 0){
+        return false;
+    }
+    (*job.task)(i);
+    if (--job.remaining == 0){
+        std::lock_guard<std::mutex> done_lock(job.done_lock);
+        job.done.notify_all();
+    }
+    return true;
+}
+
+/**
+ * Changes the number of worker threads of the pool (only when no parallel loop is running).
+ * 
+ * @param n_workers             Number of worker threads.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void thread_pool::resize(int n_workers){
+    if ((int) threads.size() == n_workers){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> pool_lock(lock);
+        stop = true;
+    }
+    wakeup.notify_all();
+    for (std::thread& thread : threads){
+        thread.join();
+    }
+    threads.clear();
+    stop = false;
+    for (int slot = 1; slot <= n_workers; ++slot){
+        threads.push_back(std::thread(&thread_pool::work, this, slot));
+    }
+}
+
+/**
+ * Main loop of a worker thread: executes tasks of the most recent parallel loop until the pool is stopped.
+ * 
+ * @param slot                  Index of the range the worker starts with.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void thread_pool::work(int slot){
+    thread_slot = slot;
+    std::unique_lock<std::mutex> pool_lock(lock);
+    while (true){
+        wakeup.wait(pool_lock, [this](){return stop || !jobs.empty();});
+        if (stop){
+            return;
+        }
+        // Most recent job first, such that nested loops finish and unblock the loop that is waiting for them
+        std::shared_ptr<parallel_job> job = jobs.back();
+        pool_lock.unlock();
+        while (run_task(*job, slot)){}
+        pool_lock.lock();
+        // All tasks are started -> nothing left to take from this job
+        for (size_t k = 0; k < jobs.size(); ++k){
+            if (jobs[k] == job){
+                jobs.erase(jobs.begin() + k);
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Executes a number of independent tasks in parallel and waits until all of them are finished.
+ * 
+ * The tasks are executed by a persistent pool of worker threads with work stealing.
+ * The calling thread takes part in the execution, so parallel loops can be nested.
+ * 
+ * @param n_tasks               Number of tasks.
+ * @param[in] task              Function that executes the task with the given index (0 to n_tasks-1).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void parallel_for(int n_tasks, const std::function<void(int)>& task){
+    int n_threads = std::min(get_num_threads(), n_tasks);
+    if (n_threads <= 1){
+        for (int i = 0; i < n_tasks; ++i){
+            task(i);
+        }
+        return;
+    }
+    // Start the worker threads (or change their number) when this is not a nested loop
+    if (thread_slot == 0 && nesting == 0){
+        pool.resize(get_num_threads() - 1);
+    }
+
+    // Divide the tasks equally over the ranges of the participants
+    std::shared_ptr<parallel_job> job = std::make_shared<parallel_job>(n_threads);
+    job->task = &task;
+    job->remaining = n_tasks;
+    for (int r = 0; r < n_threads; ++r){
+        job->ranges[r].begin = (long long) n_tasks * r / n_threads;
+        job->ranges[r].end = (long long) n_tasks * (r + 1) / n_threads;
+    }
+    {
+        std::lock_guard<std::mutex> pool_lock(pool.lock);
+        pool.jobs.push_back(job);
+    }
+    pool.wakeup.notify_all();
+
+    // The calling thread also executes tasks and then waits for the tasks started by other threads
+    ++nesting;
+    while (run_task(*job, thread_slot)){}
+    --nesting;
+    {
+        std::unique_lock<std::mutex> done_lock(job->done_lock);
+        job->done.wait(done_lock, [&job](){return job->remaining == 0;});
+    }
+    std::lock_guard<std::mutex> pool_lock(pool.lock);
+    for (size_t k = 0; k < pool.jobs.size(); ++k){
+        if (pool.jobs[k] == job){
+            pool.jobs.erase(pool.jobs.begin() + k);
+            break;
+        }
+    }
+}
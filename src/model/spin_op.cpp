@@ -51,14 +51,14 @@ std::vector<__uint128_t> convert_representation(std::vector<int>& a, int n, int
 /**
  * Determines the spin value of a given operator for a given state.
  * 
- * @param[in] state             A state represented as n_ints 128bit integers.
- * @param[in] op                An operator represented as n_ints 128bit integers.
+ * @param[in] state             Pointer to a state represented as n_ints 128bit integers.
+ * @param[in] op                Pointer to an operator represented as n_ints 128bit integers.
  * @param q                     Number of values a single variable can take.
  * @param n_ints                Number of 128bit integers
  * 
  * @return The spin value of the operator for the given state.
  */
-int spin_value(std::vector<__uint128_t>& state, std::vector<__uint128_t>& op, int q, int n_ints){
+int spin_value(const __uint128_t* state, const __uint128_t* op, int q, int n_ints){
     // s = sum(alpha_j * mu_j) mod q
     int spin = 0;
     int element_j = 1;
@@ -99,27 +99,38 @@ double entropy(std::vector<double>& prob_distr){
 /**
  * Calculates the entropy of a spin operator for a given dataset.
  * 
- * @param[in] data              Dataset containing observations as n_ints 128bit integers.
+ * @param[in] data              Dataset containing the different states as n_ints 128bit integers and their number of occurrences.
  * @param[in] op                An operator represented as n_ints 128bit integers.
  * @param q                     Number of values a single variable can take.
  * @param n_ints                Number of 128bit integers
  * 
  * @return The entropy of the operator.
  */
-double entropy_of_op(std::vector<std::vector<__uint128_t>>& data, std::vector<__uint128_t>& op, int q, int n_ints){
+double entropy_of_op(dataset& data, std::vector<__uint128_t>& op, int q, int n_ints){
     // Variable for probability distribution (# entries = # spin values/states)
     std::vector<double> prob_distr(q, 0);
 
     int s;
-    for (std::vector<__uint128_t>& obs : data){
-        // Determine the value of the spin operator for a given observation
-        s = spin_value(obs, op, q, n_ints);
-        // Increase the number of occurences of that spin value by 1
-        prob_distr[s] += 1; 
+    double N = 0;
+    if (q == 2 && data.slices){
+        // Parity of the operator for 64 states at once using the bit-sliced view
+        for (int j = 0; j < data.n_states; ++j){
+            N += data.weights[j];
+        }
+        prob_distr[1] = count_parity(*data.slices, op[0]);
+        prob_distr[0] = N - prob_distr[1];
+    }
+    else{
+        for (int j = 0; j < data.n_states; ++j){
+            // Determine the value of the spin operator for a given state
+            s = spin_value(data.states + (size_t) j * n_ints, op.data(), q, n_ints);
+            // Increase the number of occurences of that spin value by the multiplicity of the state
+            prob_distr[s] += data.weights[j];
+            N += data.weights[j];
+        }
     }
 
     // Normalize the distribution
-    int N = data.size();
     for (int i = 0; i < q; ++i){
         prob_distr[i] /= N;
     }
@@ -0,0 +1,131 @@
+#include "model.h"
+
+/**
+ * Adds a value to a histogram with fixed bin width.
+ * 
+ * @param[in, out] histogram    Histogram (the range of the bins grows when necessary).
+ * @param value                 Value that is added.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void add_to_histogram(evidence_histogram& histogram, double value){
+    int64_t bin = floor(value / histogram.width);
+    add_to_bin(histogram, bin, 1);
+}
+
+/**
+ * Increases the count of a bin in a histogram.
+ * 
+ * @param[in, out] histogram    Histogram (the range of the bins grows when necessary).
+ * @param bin                   Index of the bin (bin b contains the values in [b * width, (b+1) * width)).
+ * @param count                 Value by which the count is increased.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void add_to_bin(evidence_histogram& histogram, int64_t bin, uint64_t count){
+    if (histogram.counts.empty()){
+        histogram.first_bin = bin;
+    }
+    if (bin < histogram.first_bin){
+        // Add empty bins in front
+        histogram.counts.insert(histogram.counts.begin(), histogram.first_bin - bin, 0);
+        histogram.first_bin = bin;
+    }
+    if (bin - histogram.first_bin >= (int64_t) histogram.counts.size()){
+        histogram.counts.resize(bin - histogram.first_bin + 1, 0);
+    }
+    histogram.counts[bin - histogram.first_bin] += count;
+}
+
+/**
+ * Adds the counts of one histogram to another histogram with the same bin width.
+ * 
+ * @param[in, out] histogram    Histogram that will contain the sum of both histograms.
+ * @param[in] other             Histogram that is added.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void merge_histograms(evidence_histogram& histogram, const evidence_histogram& other){
+    for (int64_t i = 0; i < (int64_t) other.counts.size(); ++i){
+        if (other.counts[i]){
+            add_to_bin(histogram, other.first_bin + i, other.counts[i]);
+        }
+    }
+}
+
+/**
+ * Comparing function that orders partitions from high to low log evidence (ties are ordered by the components).
+ * 
+ * @param[in] p1                Pair containing the log evidence and the partition.
+ * @param[in] p2                Pair containing the log evidence and the partition.
+ * 
+ * @return True if the first partition is better.
+ */
+bool comp_top(const std::pair<double, std::vector<__uint128_t>>& p1, const std::pair<double, std::vector<__uint128_t>>& p2){
+    if (p1.first != p2.first){
+        return p1.first > p2.first;
+    }
+    return p1.second < p2.second;
+}
+
+/**
+ * Determines if a partition with a given log evidence can enter the list of best partitions.
+ * 
+ * @param[in] top               Bounded list of the best partitions.
+ * @param log_evidence          Log evidence of the partition.
+ * 
+ * @return True if the list is not full or the log evidence is at least the smallest one in the list.
+ */
+bool enters_top(const top_partitions& top, double log_evidence){
+    return top.heap.size() < top.k || log_evidence >= top.heap.front().first;
+}
+
+/**
+ * Adds a partition to the bounded list of the best partitions.
+ * 
+ * @param[in, out] top          Bounded list of the best partitions (a heap with the worst partition at the front).
+ * @param log_evidence          Log evidence of the partition.
+ * @param[in] partition         Partition as a vector of n integers representing the components.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void add_to_top(top_partitions& top, double log_evidence, const std::vector<__uint128_t>& partition){
+    std::pair<double, std::vector<__uint128_t>> entry(log_evidence, partition);
+    if (top.heap.size() < top.k){
+        top.heap.push_back(entry);
+        std::push_heap(top.heap.begin(), top.heap.end(), comp_top);
+    }
+    else if (comp_top(entry, top.heap.front())){
+        // Replace the worst partition in the list
+        std::pop_heap(top.heap.begin(), top.heap.end(), comp_top);
+        top.heap.back() = entry;
+        std::push_heap(top.heap.begin(), top.heap.end(), comp_top);
+    }
+}
+
+/**
+ * Adds the partitions of one bounded list to another one.
+ * 
+ * @param[in, out] top          Bounded list that will contain the best partitions of both lists.
+ * @param[in] other             Bounded list that is added.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void merge_top(top_partitions& top, const top_partitions& other){
+    for (const std::pair<double, std::vector<__uint128_t>>& entry : other.heap){
+        add_to_top(top, entry.first, entry.second);
+    }
+}
+
+/**
+ * Returns the partitions in a bounded list from high to low log evidence.
+ * 
+ * @param[in] top               Bounded list of the best partitions.
+ * 
+ * @return Vector of pairs containing the log evidence and the partition.
+ */
+std::vector<std::pair<double, std::vector<__uint128_t>>> sorted_top(const top_partitions& top){
+    std::vector<std::pair<double, std::vector<__uint128_t>>> sorted = top.heap;
+    std::sort(sorted.begin(), sorted.end(), comp_top);
+    return sorted;
+}
@@ -0,0 +1,144 @@
+#include "search.h"
+
+/**
+ * Calculates for every set of the first i variables the largest log evidence of a component that extends it with variables i to n-1.
+ * 
+ * @param[in] model             Struct containing the characteristic of the model (the evidence of all components should be stored).
+ * @param[in, out] bounds       Vector that will contain n+1 levels, level i has 2^i values (the empty set has value 0).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void calc_component_bounds(mcm& model, std::vector<std::vector<double>>& bounds){
+    bounds.assign(model.n + 1, std::vector<double>());
+    // Level n: the component itself
+    uint64_t n_sets = (uint64_t) 1 << model.n;
+    bounds[model.n].assign(n_sets, 0);
+    for (uint64_t set = 1; set < n_sets; ++set){
+        bounds[model.n][set] = model.evidence_storage_es[set-1];
+    }
+    // Level i: either variable i is added to the component or not
+    for (int i = model.n - 1; i >= 0; --i){
+        uint64_t n_level = (uint64_t) 1 << i;
+        uint64_t element = n_level;
+        bounds[i].assign(n_level, 0);
+        for (uint64_t set = 1; set < n_level; ++set){
+            bounds[i][set] = std::max(bounds[i+1][set], bounds[i+1][set | element]);
+        }
+    }
+}
+
+/**
+ * Calculates an upper bound on the log evidence of all partitions that extend a partial partition.
+ * 
+ * All log evidences are negative, so a component can at most have the evidence of its best extension and new components can at most add zero.
+ * 
+ * @param[in] search            State of the branch and bound search.
+ * @param i                     Number of variables that are already assigned.
+ * @param n_components          Number of components in the partial partition.
+ * 
+ * @return The upper bound on the log evidence.
+ */
+double partition_bound(bound_search& search, int i, int n_components){
+    double bound = 0;
+    for (int c = 0; c < n_components; ++c){
+        bound += search.bounds[i][(uint64_t) search.partition[c]];
+    }
+    return bound;
+}
+
+/**
+ * Assigns variable i to every possible component and continues with the assignments that can still reach the best log evidence.
+ * 
+ * @param[in, out] search       State of the branch and bound search.
+ * @param i                     Index of the variable that is assigned.
+ * @param n_components          Number of components in the partial partition.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void branch(bound_search& search, int i, int n_components){
+    mcm& model = *search.model;
+    if (i == model.n){
+        // Complete partition
+        double log_evidence = calc_evidence(search.partition, model);
+        if (log_evidence > search.best_evidence - evidence_tolerance){
+            search.best_mcm.push_back(search.partition);
+            search.evidence.push_back(log_evidence);
+            if (log_evidence > search.best_evidence){
+                search.best_evidence = log_evidence;
+                // Remove the partitions that are no longer within the tolerance of the best log evidence
+                size_t k = 0;
+                for (size_t p = 0; p < search.evidence.size(); ++p){
+                    if (search.evidence[p] > search.best_evidence - evidence_tolerance){
+                        search.best_mcm[k].swap(search.best_mcm[p]);
+                        search.evidence[k] = search.evidence[p];
+                        ++k;
+                    }
+                }
+                search.best_mcm.resize(k);
+                search.evidence.resize(k);
+            }
+        }
+        return;
+    }
+    __uint128_t element = (__uint128_t) 1 << i;
+    // Existing components and one new component
+    for (int c = 0; c <= n_components && c < model.n; ++c){
+        search.partition[c] += element;
+        int n_next = std::max(n_components, c + 1);
+        // Prune when no extension of the partial partition can be within the tolerance of the best log evidence
+        if (partition_bound(search, i + 1, n_next) > search.best_evidence - evidence_tolerance){
+            branch(search, i + 1, n_next);
+        }
+        search.partition[c] -= element;
+    }
+}
+
+/**
+ * Performs an exact search with branch and bound to find the best partition.
+ * 
+ * The variables are assigned one by one to a component.
+ * A partial partition is abandoned when the sum of the best extensions of its components cannot reach the best log evidence found so far.
+ * The search starts from the result of the greedy search and divide and conquer, so pruning is effective from the start.
+ * 
+ * @param[in, out] model        Struct containing the characteristic of the model.
+ *                              -'best_mcm' will contain all partitions with the largest evidence (same order as the exhaustive search).
+ *                              -'evidence' will be the evidence of the partition(s) found by the algorithm.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void branch_and_bound_search(mcm& model){
+    model.best_mcm.clear();
+    model.best_evidence = -DBL_MAX;
+    if (model.n > 30){
+        std::cout << "Too many variables for the branch and bound search. Maximum system size is 30." << std::endl;
+        return;
+    }
+
+    // Initial best log evidence from the heuristic searches (without writing their steps to the log files)
+    bool log_file = model.log_file;
+    model.log_file = false;
+    greedy_search(model);
+    double initial_evidence = model.best_evidence;
+    model.best_mcm.clear();
+    divide_and_conquer(model);
+    initial_evidence = std::max(initial_evidence, model.best_evidence);
+    model.best_mcm.clear();
+    model.log_file = log_file;
+
+    // Evidence of all components and the bounds on their extensions
+    calc_all_evidence_icc(model);
+    bound_search search;
+    search.model = &model;
+    calc_component_bounds(model, search.bounds);
+    search.partition.assign(model.n, 0);
+    search.best_evidence = initial_evidence;
+
+    // Variable 0 is always in the first component
+    search.partition[0] = 1;
+    branch(search, 1, 1);
+
+    // The heuristic result is found again by the search, so the list of best partitions is complete
+    model.best_evidence = search.best_evidence;
+    model.best_mcm = search.best_mcm;
+    std::sort(model.best_mcm.begin(), model.best_mcm.end(), comp_rgs);
+}
@@ -0,0 +1,240 @@
+#include "search.h"
+
+#include <cstring>
+#include <cstdio>
+
+/**
+ * Writes a value to a binary file.
+ * 
+ * @param[in, out] file         Binary output file.
+ * @param[in] value             Value that is written.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+template <typename T>
+void write_value(std::ofstream& file, const T& value){
+    file.write((const char*) &value, sizeof(T));
+}
+
+/**
+ * Reads a value from a binary file.
+ * 
+ * @param[in, out] file         Binary input file.
+ * @param[in, out] value        Value that is read.
+ * 
+ * @return True if the value could be read.
+ */
+template <typename T>
+bool read_value(std::ifstream& file, T& value){
+    file.read((char*) &value, sizeof(T));
+    return !file.fail();
+}
+
+/**
+ * Writes the progress of an exhaustive search to a checkpoint file with a given header.
+ * 
+ * The file is first written under a temporary name and then renamed, so an interruption never leaves a corrupted checkpoint.
+ * 
+ * @param file                  Path to the checkpoint file.
+ * @param[in, out] header       Header of the checkpoint file ('magic', 'version' and 'n_units' are filled in).
+ * @param[in] progress          Progress of the exhaustive search.
+ * 
+ * @return True if the checkpoint is written.
+ */
+bool write_checkpoint_file(std::string file, checkpoint_header& header, search_progress& progress){
+    std::string temporary_file = file + ".tmp";
+    std::ofstream output(temporary_file, std::ios::binary);
+    if (output.fail()){
+        std::cout << "Not able to create the checkpoint file." << std::endl;
+        return false;
+    }
+    memcpy(header.magic, "MCMC", 4);
+    header.version = 1;
+    header.n_units = progress.done.size();
+    write_value(output, header);
+    output.write(progress.done.data(), progress.done.size());
+
+    // Best partitions
+    unit_result& result = progress.result;
+    write_value(output, result.best_evidence);
+    write_value(output, (uint64_t) result.best_mcm.size());
+    for (size_t i = 0; i < result.best_mcm.size(); ++i){
+        write_value(output, result.evidence[i]);
+        output.write((const char*) result.best_mcm[i].data(), header.n * sizeof(__uint128_t));
+    }
+
+    // Histogram
+    write_value(output, result.histogram.width);
+    write_value(output, result.histogram.first_bin);
+    write_value(output, (uint64_t) result.histogram.counts.size());
+    output.write((const char*) result.histogram.counts.data(), result.histogram.counts.size() * sizeof(uint64_t));
+
+    // List of the best partitions
+    write_value(output, (uint64_t) result.top_mcm.k);
+    write_value(output, (uint64_t) result.top_mcm.heap.size());
+    for (std::pair<double, std::vector<__uint128_t>>& entry : result.top_mcm.heap){
+        write_value(output, entry.first);
+        output.write((const char*) entry.second.data(), header.n * sizeof(__uint128_t));
+    }
+    output.close();
+    if (output.fail() || std::rename(temporary_file.c_str(), file.c_str()) != 0){
+        std::cout << "Not able to write the checkpoint file." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Writes the progress of an exhaustive search to a checkpoint file.
+ * 
+ * @param file                  Path to the checkpoint file.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param[in] progress          Progress of the exhaustive search.
+ * 
+ * @return True if the checkpoint is written.
+ */
+bool write_checkpoint(std::string file, mcm& model, search_progress& progress){
+    checkpoint_header header;
+    memset(&header, 0, sizeof(header));
+    header.n = model.n;
+    header.q = model.q;
+    header.N = model.N;
+    header.checksum = data_checksum(model.data);
+    header.k = progress.k;
+    header.shard = model.shard;
+    header.n_shards = progress.n_shards;
+    return write_checkpoint_file(file, header, progress);
+}
+
+/**
+ * Checks that a number of entries of a given size fits in the rest of a binary file.
+ * 
+ * @param[in, out] file         Binary input file.
+ * @param file_size             Size of the file in bytes.
+ * @param n_entries             Number of entries that is read next.
+ * @param entry_size            Size of an entry in bytes.
+ * 
+ * @return True if the entries fit in the file (false if the file could not be read so far).
+ */
+bool fits_in_file(std::ifstream& file, uint64_t file_size, uint64_t n_entries, uint64_t entry_size){
+    if (!file){
+        return false;
+    }
+    uint64_t position = file.tellg();
+    return position <= file_size && n_entries <= (file_size - position) / entry_size;
+}
+
+/**
+ * Reads the progress of an exhaustive search from a checkpoint file without checking the dataset.
+ * 
+ * Every number of entries is checked against the size of the file before it is allocated,
+ * and the number of work units has to be Bell(k).
+ * 
+ * @param file                  Path to the checkpoint file.
+ * @param[in, out] header       Header of the checkpoint file.
+ * @param[in, out] progress     Progress of the exhaustive search.
+ * 
+ * @return True if the checkpoint is read, false if the file is not found or is corrupted.
+ */
+bool read_checkpoint_file(std::string file, checkpoint_header& header, search_progress& progress){
+    std::ifstream input(file, std::ios::binary | std::ios::ate);
+    if (input.fail()){
+        std::cout << "Not able to open the checkpoint file " << file << "." << std::endl;
+        return false;
+    }
+    uint64_t file_size = input.tellg();
+    input.seekg(0);
+    if (!read_value(input, header) || memcmp(header.magic, "MCMC", 4) != 0 || header.version != 1){
+        std::cout << "The checkpoint file " << file << " is not valid." << std::endl;
+        return false;
+    }
+    if (header.n < 1 || header.n > 128 || header.k < 1 || header.k > header.n || header.n_shards < 1 ||
+        header.n_units != bell_number(header.k) || !fits_in_file(input, file_size, header.n_units, 1)){
+        std::cout << "The checkpoint file " << file << " is not valid." << std::endl;
+        return false;
+    }
+    search_progress checkpoint;
+    checkpoint.n_shards = header.n_shards;
+    checkpoint.k = header.k;
+    checkpoint.done.resize(header.n_units);
+    input.read(checkpoint.done.data(), header.n_units);
+
+    // Best partitions
+    unit_result& result = checkpoint.result;
+    uint64_t partition_size = header.n * sizeof(__uint128_t);
+    uint64_t n_best = 0;
+    read_value(input, result.best_evidence);
+    read_value(input, n_best);
+    bool valid = fits_in_file(input, file_size, n_best, sizeof(double) + partition_size);
+    for (uint64_t i = 0; i < n_best && valid && input; ++i){
+        double log_evidence;
+        std::vector<__uint128_t> partition(header.n);
+        read_value(input, log_evidence);
+        input.read((char*) partition.data(), partition_size);
+        result.evidence.push_back(log_evidence);
+        result.best_mcm.push_back(partition);
+    }
+
+    // Histogram
+    uint64_t n_bins = 0;
+    read_value(input, result.histogram.width);
+    read_value(input, result.histogram.first_bin);
+    read_value(input, n_bins);
+    valid = valid && fits_in_file(input, file_size, n_bins, sizeof(uint64_t));
+    if (valid){
+        result.histogram.counts.resize(n_bins);
+        input.read((char*) result.histogram.counts.data(), n_bins * sizeof(uint64_t));
+    }
+
+    // List of the best partitions
+    uint64_t top_k = 0;
+    uint64_t n_top = 0;
+    read_value(input, top_k);
+    read_value(input, n_top);
+    valid = valid && n_top <= top_k && fits_in_file(input, file_size, n_top, sizeof(double) + partition_size);
+    result.top_mcm.k = top_k;
+    for (uint64_t i = 0; i < n_top && valid && input; ++i){
+        std::pair<double, std::vector<__uint128_t>> entry(0, std::vector<__uint128_t>(header.n));
+        read_value(input, entry.first);
+        input.read((char*) entry.second.data(), partition_size);
+        result.top_mcm.heap.push_back(entry);
+    }
+    if (!valid || input.fail()){
+        std::cout << "The checkpoint file " << file << " is corrupted." << std::endl;
+        return false;
+    }
+    progress = checkpoint;
+    return true;
+}
+
+/**
+ * Reads the progress of an exhaustive search from a checkpoint file.
+ * 
+ * @param file                  Path to the checkpoint file.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param[in, out] progress     Progress of the exhaustive search.
+ * 
+ * @return True if the checkpoint is read, false if the file is not found, belongs to another dataset or search, or is corrupted.
+ */
+bool read_checkpoint(std::string file, mcm& model, search_progress& progress){
+    checkpoint_header header;
+    search_progress checkpoint;
+    if (!read_checkpoint_file(file, header, checkpoint)){
+        std::cout << "Starting a new search." << std::endl;
+        return false;
+    }
+    if (header.n != model.n || header.q != model.q || header.N != model.N || header.checksum != data_checksum(model.data)){
+        std::cout << "The checkpoint file belongs to another dataset, starting a new search." << std::endl;
+        return false;
+    }
+    if (header.n_shards != std::max(model.n_shards, 1) || (header.n_shards > 1 && header.shard != model.shard)){
+        std::cout << "The checkpoint file belongs to another shard, starting a new search." << std::endl;
+        return false;
+    }
+    if (checkpoint.result.histogram.width != model.histogram.width || checkpoint.result.top_mcm.k != model.top_mcm.k){
+        std::cout << "The checkpoint file was written with other -hist or -topk options, starting a new search." << std::endl;
+        return false;
+    }
+    progress = checkpoint;
+    return true;
+}
@@ -3,6 +3,9 @@
 /**
  * Performs a divide and conquer procedure to find an estimation of the best partition.
  * 
+ * The splits of the components are independent of each other, so the two parts of a split are divided further as parallel tasks.
+ * The partition (and the log file) is assembled afterwards in the same order as a sequential recursion.
+ * 
  * @param[in, out] model        Struct containing the characteristic of the model. 
  *                              -'best_mcm[0]' will contain the partition with the largest evidence found by the algorithm.
  *                              -'evidence' will be the evidence of the partition found by the algorithm.
@@ -25,40 +28,48 @@ void divide_and_conquer(mcm&model){
         partition[0] += element;
         element <<= 1;
     }
-    // Store the starting partition because it will be updated during the recursive process
-    model.best_mcm.push_back(partition);
 
     // Write to file
     if(model.log_file){
         *model.divide_and_conquer_file << "Start divide and conquer procedure" << std::endl;
     }
 
-    // Start recursive algorithm by moving variables from component 0 to component 1
-    division(0, 1, model);
+    // Recursive splitting of the complete component
+    split_node root;
+    root.component = partition[0];
+    division(root, model);
+
+    // Assign the components to the partition by moving variables from component 0 to component 1
+    assemble_partition(root, 0, 1, partition, model);
+    model.best_mcm.push_back(partition);
+    model.evidence_storage.swap(root.storage);
 
     // Calculate the evidence of the best MCM found by the search algorithm
     model.best_evidence = calc_evidence(model.best_mcm[0], model);
 }
 
 /**
- * Recursive division procedure used during the divide and conquer algorithm.
+ * Finds the best split of a component by moving its variables one by one to a second component.
  * 
- * @param move_from             Index of the component from which variables are moved
- * @param move_to               Index of the component to which variables are moved
- * @param[in, out] model        Struct containing the characteristic of the model.
- *                              -'best_mcm[0]' will be updated if a split occurs that increases the evidence.
+ * @param[in, out] node         Node of the recursion with the component that is split.
+ *                              -'steps' will contain the steps of the procedure for the log file.
+ *                              -'parts' will contain the two parts if a split increases the evidence.
+ *                              -'storage' will contain the evidence of the evaluated components.
+ * @param[in] model             Struct containing the characteristic of the model.
  * 
- * @return Index of the next empty component
+ * @return void                 Nothing is returned by this function.
  */
-
-int division(int move_from, int move_to, mcm& model){
+void split_component(split_node& node, mcm& model){
     // Number of member in the component that we want to split
-    int n_members_1 = component_size(model.best_mcm[0][move_from]);
+    int n_members_1 = component_size(node.component);
     // If the component contains 1 variable, no further splits are possible
-    if (n_members_1 == 1){return move_to;}
+    if (n_members_1 == 1){return;}
 
-    // Hard copy of the starting partition
-    std::vector<__uint128_t> partition = model.best_mcm[0];
+    // Best split so far and the starting point of the next round of moves
+    __uint128_t best_part_1 = node.component;
+    __uint128_t best_part_2 = 0;
+    __uint128_t part_1 = node.component;
+    __uint128_t part_2 = 0;
 
     // Variables for the difference in evidence before and after split
     double best_evidence_diff = 0;
@@ -69,83 +80,205 @@ int division(int move_from, int move_to, mcm& model){
     __uint128_t component_1;
     __uint128_t component_2;
 
-    // Variable to indicate which member is moving
-    __uint128_t member;
-
     // Calculate the evidence of the component before splitting (reference point for the difference in evidence)
-    double evidence_unsplit_component = get_evidence_icc(partition[move_from], model);
+    get_evidence_batch(std::vector<__uint128_t>(1, node.component), model, node.storage);
+    double evidence_unsplit_component = node.storage[node.component];
 
     // If the component has more than 2 members, we can skip the last step because it is the same as the first step
     if (n_members_1 > 2){n_members_1 -= 1;}
-    
+
     while (n_members_1 > 1){
         // Initial values
         best_evidence_diff_tmp = -DBL_MAX; 
-        component_1 = partition[move_from];
-        component_2 = partition[move_to];
-
-        // Write to file
-        if(model.log_file){
-            *model.divide_and_conquer_file << "\nStart moving variables from component " << move_from << " to component " << move_to << std::endl;
-            print_partition_to_file(*model.divide_and_conquer_file, partition);
-        }
+        component_1 = part_1;
+        component_2 = part_2;
+        node.steps.push_back({start_moving, part_1, part_2, 0, 0});
 
-        // Move each variable sequentially to component 'move_to'
-        for (int i = 0; i <= n_members_1; i++){
+        // Evaluate the moves of all variables in parallel
+        int n_moves = std::min(n_members_1 + 1, component_size(component_1));
+        std::vector<__uint128_t> members(n_moves);
+        for (int i = 0; i < n_moves; i++){
             // Integer representation of the bitstring with only a 1 in the position of the (i+1)th bit set to 1 in component
-            member = find_member_i(component_1, i+1);
-            component_1 -= member;
-            component_2 += member;
+            members[i] = find_member_i(component_1, i+1);
+        }
+        evaluate_moves(component_1, component_2, members, model, node.storage);
 
+        // Move each variable sequentially to the second component
+        for (int i = 0; i < n_moves; i++){
             // Calculate difference in evidence from splitting
-            evidence_diff = get_evidence_icc(component_1, model) + get_evidence_icc(component_2, model) - evidence_unsplit_component;
+            evidence_diff = node.storage[component_1 - members[i]] + node.storage[component_2 + members[i]] - evidence_unsplit_component;
 
             // Check if this difference is the best one so far (even if negative)
             if (evidence_diff > best_evidence_diff_tmp){
                 // Update the temporary best difference
                 best_evidence_diff_tmp = evidence_diff;
                 // Update partition
-                partition[move_from] = component_1;
-                partition[move_to] = component_2;
-
-                // Write to file
-                if(model.log_file){
-                    *model.divide_and_conquer_file << "\nBest intermediate split: moving variable " << index_of_member(member) << " from component " << move_from << " to component " << move_to << " Evidence difference: " << best_evidence_diff_tmp << std::endl;
-                    print_partition_to_file(*model.divide_and_conquer_file, partition);
-                }
+                part_1 = component_1 - members[i];
+                part_2 = component_2 + members[i];
+                node.steps.push_back({intermediate_split, part_1, part_2, index_of_member(members[i]), best_evidence_diff_tmp});
             }
-
-            // Move variable back to component 'move_from'
-            component_1 += member;
-            component_2 -= member;
         }
         // Check if the split results in an overall improvement of the evidence
         if (best_evidence_diff_tmp > best_evidence_diff){
             // Update the best difference
             best_evidence_diff = best_evidence_diff_tmp;
-            // Update the best MCM
-            model.best_mcm[0][move_from] = partition[move_from];
-            model.best_mcm[0][move_to] = partition[move_to];
-
-            // Write to file
-            if(model.log_file){
-                *model.divide_and_conquer_file << "\nNew best split" << std::endl;
-                print_partition_to_file(*model.divide_and_conquer_file, partition);
-            }
+            // Update the best split
+            best_part_1 = part_1;
+            best_part_2 = part_2;
+            node.steps.push_back({new_best_split, part_1, part_2, 0, 0});
         }
         // Update number of members
         n_members_1 -= 1;
     }
-    // Stop if no split increased the evidence -> component 'move_to' will be empty in that case
-    if (model.best_mcm[0][move_to] == 0){
+    // Only store the parts if a split increased the evidence
+    if (best_part_2 != 0){
+        node.parts.resize(2);
+        node.parts[0].component = best_part_1;
+        node.parts[1].component = best_part_2;
+    }
+}
+
+/**
+ * Calculates in parallel the log evidence of the components that result from moving one variable from one component to another.
+ * 
+ * The counts of the first component without the variable are derived from the counting table of the first component,
+ * the counts of the second component with the variable from the labels of the states of the second component.
+ * Both take a single pass over the dataset for all moves together, instead of one pass per evaluated component.
+ * 
+ * @param component_1           Component from which the variables are moved.
+ * @param component_2           Component to which the variables are moved (can be empty).
+ * @param[in] members           Integer representations of the bitstrings of the variables that are moved.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * @param[in, out] storage      Map from the components to their log evidence (the evaluated components are added).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void evaluate_moves(__uint128_t component_1, __uint128_t component_2, std::vector<__uint128_t>& members, mcm& model, std::map<__uint128_t, double>& storage){
+    int n_moves = members.size();
+    int r_1 = component_size(component_1);
+    int r_2 = component_size(component_2);
+
+    // Moves that are not in the storage yet
+    std::vector<int> missing_1;
+    std::vector<int> missing_2;
+    for (int i = 0; i < n_moves; i++){
+        if (storage.count(component_1 - members[i]) == 0){missing_1.push_back(i);}
+        if (storage.count(component_2 + members[i]) == 0){missing_2.push_back(i);}
+    }
+    // Counting table of the first component and labels of the states of the second component
+    count_table counts_1;
+    std::vector<unsigned int> labels_2;
+    int n_labels_2 = 0;
+    if (!missing_1.empty()){
+        count_component(model, component_1, counts_1);
+    }
+    if (!missing_2.empty()){
+        n_labels_2 = label_observations(model, component_2, labels_2);
+    }
+
+    int n_missing_1 = missing_1.size();
+    std::vector<double> log_evidence(n_missing_1 + missing_2.size());
+    parallel_for(log_evidence.size(), [&](int k){
+        if (k < n_missing_1){
+            // Sum the counts over the values of the variable
+            static thread_local count_table marginal;
+            marginalize_table(counts_1, members[missing_1[k]], marginal);
+            log_evidence[k] = evidence_from_table(marginal, r_1 - 1, model);
+        }
+        else{
+            log_evidence[k] = evidence_of_extension(model, labels_2, n_labels_2, members[missing_2[k - n_missing_1]], r_2 + 1);
+        }
+    });
+
+    // Store the results
+    for (int k = 0; k < n_missing_1; k++){
+        storage[component_1 - members[missing_1[k]]] = log_evidence[k];
+    }
+    for (size_t k = 0; k < missing_2.size(); k++){
+        storage[component_2 + members[missing_2[k]]] = log_evidence[n_missing_1 + k];
+    }
+}
+
+/**
+ * Recursive division procedure used during the divide and conquer algorithm.
+ * 
+ * @param[in, out] node         Node of the recursion with the component that is split.
+ *                              -'parts' will contain the recursive divisions of the two parts (empty if the component is not split).
+ *                              -'storage' will contain the evidence of all components evaluated in the recursion.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void division(split_node& node, mcm& model){
+    split_component(node, model);
+    // Stop if no split increased the evidence
+    if (node.parts.empty()){return;}
+
+    // The parts start with the evidence of their subsets that is already calculated
+    for (split_node& part : node.parts){
+        for (std::pair<const __uint128_t, double>& entry : node.storage){
+            if ((entry.first & ~part.component) == 0){
+                part.storage.insert(entry);
+            }
+        }
+    }
+    // Continue with the splits of both parts in parallel
+    parallel_for(2, [&](int p){
+        division(node.parts[p], model);
+    });
+    // Collect the evidence calculated by the parts
+    for (split_node& part : node.parts){
+        node.storage.insert(part.storage.begin(), part.storage.end());
+        part.storage.clear();
+    }
+}
+
+/**
+ * Assigns the components found by the recursive division to the partition and writes the steps to the log file.
+ * 
+ * The indices of the components are the same as in a sequential recursion: the first part keeps the index of the split component,
+ * the second part gets the first empty index and the first part is divided before the second part.
+ * 
+ * @param[in] node              Node of the recursion.
+ * @param move_from             Index of the component from which variables are moved
+ * @param move_to               Index of the component to which variables are moved
+ * @param[in, out] partition    Partition that contains the components assigned so far.
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return Index of the next empty component
+ */
+int assemble_partition(split_node& node, int move_from, int move_to, std::vector<__uint128_t>& partition, mcm& model){
+    // Write to file
+    if(model.log_file){
+        std::ofstream& file = *model.divide_and_conquer_file;
+        std::vector<__uint128_t> current = partition;
+        for (split_step& step : node.steps){
+            current[move_from] = step.component_1;
+            current[move_to] = step.component_2;
+            if (step.type == start_moving){
+                file << "\nStart moving variables from component " << move_from << " to component " << move_to << std::endl;
+            }
+            else if (step.type == intermediate_split){
+                file << "\nBest intermediate split: moving variable " << step.variable << " from component " << move_from << " to component " << move_to << " Evidence difference: " << step.evidence_diff << std::endl;
+            }
+            else{
+                file << "\nNew best split" << std::endl;
+            }
+            print_partition_to_file(file, current);
+        }
+    }
+    // Component 'move_to' stays empty if there was no split
+    if (node.parts.empty()){
         return move_to;
     }
+    partition[move_from] = node.parts[0].component;
+    partition[move_to] = node.parts[1].component;
     // If there was a succesful split, component 'move_to' is no longer empty -> increase the index of the first empty component
     int first_empty = move_to + 1;
-    // Continue with a split of the first subpart
-    first_empty = division(move_from, first_empty, model);
-    // Continue with a split of the second subpart
-    first_empty = division(move_to, first_empty, model);
+    // Continue with the first subpart
+    first_empty = assemble_partition(node.parts[0], move_from, first_empty, partition, model);
+    // Continue with the second subpart
+    first_empty = assemble_partition(node.parts[1], move_to, first_empty, partition, model);
 
     return first_empty;
 }
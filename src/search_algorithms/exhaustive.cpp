@@ -1,8 +1,253 @@
 #include "search.h"
 
+#include <mutex>
+#include <chrono>
+
+/**
+ * Removes the partitions that are no longer within the tolerance of the best log evidence.
+ * 
+ * @param[in, out] result       Best partitions of a work unit.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void prune_unit_result(unit_result& result){
+    size_t k = 0;
+    for (size_t i = 0; i < result.evidence.size(); ++i){
+        if (result.evidence[i] > result.best_evidence - evidence_tolerance){
+            result.best_mcm[k].swap(result.best_mcm[i]);
+            result.evidence[k] = result.evidence[i];
+            ++k;
+        }
+    }
+    result.best_mcm.resize(k);
+    result.evidence.resize(k);
+}
+
+/**
+ * Returns the stored log evidence of a component (zero for the empty component).
+ * 
+ * @param component             Integer representation of the bitstring representing a component.
+ * @param[in] model             Struct containing the characteristic of the model (the evidence of all components should be stored).
+ * 
+ * @return Log evidence of the component.
+ */
+double stored_evidence(__uint128_t component, mcm& model){
+    return component ? model.evidence_storage_es[component-1] : 0;
+}
+
+/**
+ * Moves one variable to another component and updates the log evidence of the partition.
+ * 
+ * @param[in, out] walk         State of the enumeration of the partitions.
+ * @param i                     Index of the variable.
+ * @param to                    Index of the component to which the variable moves.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void move_variable(partition_walk& walk, int i, int to){
+    __uint128_t element = (__uint128_t) 1 << i;
+    __uint128_t& comp_from = walk.partition[walk.a[i]];
+    __uint128_t& comp_to = walk.partition[to];
+    // Only the evidence of the two components that change
+    double old_evidence = walk.log_evidence;
+    walk.log_evidence -= stored_evidence(comp_from, *walk.model) + stored_evidence(comp_to, *walk.model);
+    comp_from -= element;
+    comp_to += element;
+    walk.log_evidence += stored_evidence(comp_from, *walk.model) + stored_evidence(comp_to, *walk.model);
+    walk.a[i] = to;
+    // Four roundings, the component evidences are non-positive -> every operand is bounded by the old or new total
+    walk.error_bound += 2 * DBL_EPSILON * (std::fabs(old_evidence) + std::fabs(walk.log_evidence));
+}
+
+/**
+ * Recalculates the running log evidence of the partition that is currently visited.
+ * 
+ * @param[in, out] walk         State of the enumeration of the partitions.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void resync_evidence(partition_walk& walk){
+    walk.log_evidence = calc_evidence(walk.partition, *walk.model);
+    // Rounding error of the sum over the components
+    walk.error_bound = walk.model->n * DBL_EPSILON * std::fabs(walk.log_evidence);
+}
+
+/**
+ * Processes the partition that is currently visited by the enumeration.
+ * 
+ * @param[in, out] walk         State of the enumeration of the partitions.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void visit_partition(partition_walk& walk){
+    mcm& model = *walk.model;
+    unit_result& result = *walk.result;
+    // Limit the accumulation of rounding errors in the running log evidence
+    if (++walk.n_visited % 65536 == 0){
+        resync_evidence(walk);
+    }
+    // The running log evidence is only used to screen the partitions, candidates are recalculated exactly.
+    // The margin covers the rounding errors of the running value and of the exact value (scale with the evidence).
+    double margin = walk.error_bound + model.n * DBL_EPSILON * std::fabs(walk.log_evidence) + screening_margin;
+    double log_evidence = 0;
+    bool exact = false;
+    if (walk.log_evidence > result.best_evidence - evidence_tolerance - margin){
+        log_evidence = calc_evidence(walk.partition, model);
+        exact = true;
+        if (log_evidence > result.best_evidence - evidence_tolerance){
+            // Within the tolerance of the best log evidence -> store a hard copy
+            result.best_mcm.push_back(walk.partition);
+            result.evidence.push_back(log_evidence);
+            if (log_evidence > result.best_evidence){
+                result.best_evidence = log_evidence;
+                prune_unit_result(result);
+            }
+        }
+    }
+
+    // Distribution of the evidence of all partitions
+    if (result.histogram.width > 0){
+        add_to_histogram(result.histogram, walk.log_evidence);
+    }
+    if (result.top_mcm.k > 0 && enters_top(result.top_mcm, walk.log_evidence + margin)){
+        if (!exact){
+            log_evidence = calc_evidence(walk.partition, model);
+        }
+        add_to_top(result.top_mcm, log_evidence, walk.partition);
+    }
+}
+
+/**
+ * Enumerates all values of the restricted growth string from a given index onwards in Gray code order.
+ * 
+ * The values of a[i] are visited in the order 0, m+1, m, ..., 1 and in the reverse order on the next visit,
+ * such that consecutive partitions only differ in the component of a single variable.
+ * 
+ * @param[in, out] walk         State of the enumeration of the partitions.
+ * @param i                     Index of the first variable that is not fixed.
+ * @param m                     Largest value in a[0]...a[i-1].
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void gray_enumeration(partition_walk& walk, int i, int m){
+    if (i == walk.model->n){
+        visit_partition(walk);
+        return;
+    }
+    for (int t = 0; t <= m + 1; ++t){
+        int index = walk.forward[i] ? t : m + 1 - t;
+        int value = (index == 0) ? 0 : m + 2 - index;
+        if (value != walk.a[i]){
+            move_variable(walk, i, value);
+        }
+        gray_enumeration(walk, i + 1, std::max(m, value));
+    }
+    // Reverse the order for the next visit
+    walk.forward[i] = !walk.forward[i];
+}
+
+/**
+ * Goes through all partitions that start with a given restricted growth string (a work unit of the exhaustive search).
+ * 
+ * @param[in] prefix            Array of size k with the first k values of the restricted growth string.
+ * @param k                     Number of fixed values (at least 1).
+ * @param[in] model             Struct containing the characteristic of the model (the evidence of all components should be stored).
+ * @param[in, out] result       Struct that will contain the best partitions of the work unit.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void exhaustive_unit(int* prefix, int k, mcm& model, unit_result& result){
+    partition_walk walk;
+    walk.model = &model;
+    walk.result = &result;
+    walk.a.assign(model.n, 0);
+    walk.forward.assign(model.n, true);
+    walk.partition.assign(model.n, 0);
+    int max_value = 0;
+    for (int i = 0; i < k; ++i){
+        walk.a[i] = prefix[i];
+        max_value = std::max(max_value, prefix[i]);
+    }
+    // Partition is written as a restricted growth string -> convert it (updates 'partition')
+    convert_partition(walk.a.data(), walk.partition, model.n);
+    resync_evidence(walk);
+
+    gray_enumeration(walk, k, max_value);
+}
+
+/**
+ * Adds the results of a work unit to the results of the whole search.
+ * 
+ * @param[in, out] total        Results of the units that are already done.
+ * @param[in] result            Results of the work unit.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void merge_unit_result(unit_result& total, const unit_result& result){
+    for (size_t i = 0; i < result.best_mcm.size(); ++i){
+        if (result.evidence[i] > total.best_evidence - evidence_tolerance){
+            total.best_mcm.push_back(result.best_mcm[i]);
+            total.evidence.push_back(result.evidence[i]);
+        }
+    }
+    if (result.best_evidence > total.best_evidence){
+        total.best_evidence = result.best_evidence;
+        prune_unit_result(total);
+    }
+    if (total.histogram.width > 0){
+        merge_histograms(total.histogram, result.histogram);
+    }
+    if (total.top_mcm.k > 0){
+        merge_top(total.top_mcm, result.top_mcm);
+    }
+}
+
+/**
+ * Calculates the number of partitions of a set (Bell number), which is also the number of work units with k fixed values.
+ * 
+ * @param k                     Number of elements in the set.
+ * 
+ * @return Bell(k) (as a double to avoid an overflow for large k).
+ */
+double bell_number(int k){
+    // Row k-1 of the Bell triangle (the last element is Bell(k))
+    std::vector<double> bell_row(1, 1);
+    for (int i = 1; i < k; ++i){
+        std::vector<double> next_row(i + 1);
+        next_row[0] = bell_row.back();
+        for (int j = 1; j <= i; ++j){
+            next_row[j] = next_row[j-1] + bell_row[j-1];
+        }
+        bell_row.swap(next_row);
+    }
+    return bell_row.back();
+}
+
+/**
+ * Determines the number of fixed values in a work unit of the exhaustive search.
+ * 
+ * @param n                     Number of variables in the system.
+ * @param min_units             Minimum number of work units.
+ * 
+ * @return The smallest number k for which there are at least min_units work units (Bell(k)), or n-1 if there is none.
+ */
+int unit_prefix_length(int n, double min_units){
+    int k = 1;
+    while (k < n && bell_number(k) < min_units){
+        ++k;
+    }
+    return k;
+}
+
 /**
  * Performs an exhaustive search to find the best partition.
  * 
+ * The partitions are divided in work units that share the first values of their restricted growth string.
+ * The units are processed in parallel and their results are merged (independent of the order in which the units finish).
+ * If a checkpoint file is given, the finished units and the merged results are written to it regularly,
+ * such that an interrupted search can be resumed.
+ * If the search is sharded, only the units with index modulo the number of shards equal to the shard index are processed.
+ * 
  * @param[in, out] model        Struct containing the characteristic of the model. 
  *                              -'best_mcm' will contain all partitions with the largest evidence found by the algorithm.
  *                              -'evidence' will be the evidence of the partition(s) found by the algorithm.
@@ -12,65 +257,78 @@
 void exhaustive_search(mcm& model){
     // Reset best mcm in case another search has been ran previously
     model.best_mcm.clear();
+    model.best_evidence = -DBL_MAX;
+    model.histogram.counts.clear();
+    model.top_mcm.heap.clear();
     
-    // Indicate that this is not an exhaustive search
-    // Necessary because different data structure is used to store the evidence of ICCs
-    model.exhaustive = true;
-    // Reserve memory for storage of evidence of icc (2^n - 1 iccs) -> store in a vector because will encounter all of them in an exhaustive search
-    __uint128_t n_iccs = 1 << model.n;
-    model.evidence_storage_es.assign(n_iccs-1, 0);
-
-    // Variable to store the log evidence
-    double log_evidence;
-    // Variable to keep track of the best partition
-    std::vector<__uint128_t> best_mcm;
-    // Representation of the partition that can used by the function to calculate the evidence
-    std::vector<__uint128_t> partition(model.n, 0);
-    // Initialize arrays to keep track of the next partition to generate
-    int a[model.n];
-    int b[model.n];
-    for (int i = 0; i < model.n; i++){
-        a[i] = 0;
-        b[i] = 1;
-    }
-    // Index of first value that is different (from right to left) between a and b
-    int j = model.n - 1;
-
-    while (j != 0){
-        // Partition is written as a restricted growth string -> convert it (updates 'partition')
-        convert_partition(a, partition, model.n);
-        log_evidence = calc_evidence(partition, model);
-        // Check if this is equal to the best log evidence found so far
-        if (abs(log_evidence - model.best_evidence) < 1E-6){
-            // Found MCM with the same evidence
-            // Make a hard copy of current partition to store
-            best_mcm.assign(partition.begin(), partition.end());
-            model.best_mcm.push_back(best_mcm);
+    // Calculate the evidence of all components (2^n - 1 iccs) -> store in a vector because will encounter all of them in an exhaustive search
+    calc_all_evidence_icc(model);
+
+    // Continue from the checkpoint or start a new search
+    search_progress progress;
+    if (!(model.resume && read_checkpoint(model.checkpoint_file, model, progress))){
+        if (model.n_shards > 1){
+            // The units have to be the same for every shard, independent of the number of threads
+            progress.k = unit_prefix_length(model.n, 1024. * model.n_shards);
+            progress.n_shards = model.n_shards;
         }
-        // Check if this is the new best log evidence
-        else if (log_evidence > model.best_evidence){
-            // Update the current best
-            model.best_evidence = log_evidence;
-            // Remove all current best MCMs
-            model.best_mcm.clear();
-            // Make a hard copy of current partition to store
-            best_mcm.assign(partition.begin(), partition.end());
-            model.best_mcm.push_back(best_mcm);
+        else{
+            // Enough units to keep all threads busy
+            progress.k = unit_prefix_length(model.n, 64. * get_num_threads());
         }
+        progress.result.histogram.width = model.histogram.width;
+        progress.result.top_mcm.k = model.top_mcm.k;
+    }
+    int k = progress.k;
 
-        // Store evidence of all partitions
-        if (model.store_all_ev){
-            model.all_evidence.push_back(log_evidence);
+    // Generate all restricted growth strings of length k (the prefixes of the work units)
+    std::vector<std::vector<int>> prefixes;
+    std::vector<int> a(k, 0);
+    std::vector<int> b(k, 1);
+    do{
+        prefixes.push_back(a);
+    } while (generate_next_partition(a.data(), b.data(), k));
+    progress.done.resize(prefixes.size(), 0);
+
+    // Units of this shard that still have to be processed
+    std::vector<int> units;
+    for (size_t unit = 0; unit < prefixes.size(); ++unit){
+        if (!progress.done[unit] && unit % progress.n_shards == (size_t) model.shard){
+            units.push_back(unit);
         }
+    }
+
+    // Process the units in parallel (every unit has its own results that are merged when it is done)
+    std::mutex lock;
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    parallel_for(units.size(), [&](int u){
+        int unit = units[u];
+        unit_result result;
+        result.histogram.width = progress.result.histogram.width;
+        result.top_mcm.k = progress.result.top_mcm.k;
+        exhaustive_unit(prefixes[unit].data(), k, model, result);
 
-        j = generate_next_partition(a, b, model.n);
-        if (j == 0){
-            // All possible partitions are generated
-            break;
+        std::lock_guard<std::mutex> guard(lock);
+        merge_unit_result(progress.result, result);
+        progress.done[unit] = 1;
+        if (!model.checkpoint_file.empty()){
+            auto now = std::chrono::steady_clock::now();
+            if (std::chrono::duration<double>(now - last_checkpoint).count() >= model.checkpoint_interval){
+                write_checkpoint(model.checkpoint_file, model, progress);
+                last_checkpoint = now;
+            }
         }
-        // Reset the converted partition
-        std::fill(partition.begin(), partition.end(), 0);
+    });
+    if (!model.checkpoint_file.empty()){
+        write_checkpoint(model.checkpoint_file, model, progress);
     }
+
+    // Final results, best partitions in the order of enumeration
+    model.best_evidence = progress.result.best_evidence;
+    model.best_mcm = progress.result.best_mcm;
+    std::sort(model.best_mcm.begin(), model.best_mcm.end(), comp_rgs);
+    model.histogram = progress.result.histogram;
+    model.top_mcm = progress.result.top_mcm;
 }
 
 /**
@@ -79,10 +337,15 @@ void exhaustive_search(mcm& model){
  * @param[in, out] a            Array of size n that represents the partition as a restricted growth string.
  * @param[in, out] b            Array of size n that keeps track of how many partitions each variable can move to.
  * @param n                     Number of variables.
+ * @param k                     Number of values at the start of 'a' that are kept fixed (at least 1).
  * 
  * @return 1 if next partition is generated, 0 if all partitions are generated.
  */
-int generate_next_partition(int* a, int* b, int n){
+int generate_next_partition(int* a, int* b, int n, int k){
+    if (k >= n){
+        // All values are fixed -> only one partition
+        return 0;
+    }
     // Compare the last bit
     if (a[n-1] != b[n-1]){
         // Increase the last bit of 'a' by 1 to generate new partition
@@ -90,8 +353,8 @@ int generate_next_partition(int* a, int* b, int n){
         return 1;
     }
     // Find the first bit that is different (starting from the right)
-    int j = find_j(a, b, n);
-    if (j == 0){
+    int j = find_j(a, b, n, k);
+    if (j < k){
         // All bits are the same -> all possible partitions are generated
         return 0;
     }
@@ -118,11 +381,12 @@ int generate_next_partition(int* a, int* b, int n){
  * @param[in] a                 Array of size n.
  * @param[in] b                 Array of size n.
  * @param n                     size of the arrays.
+ * @param k                     Number of values at the start of the arrays that are kept fixed (at least 1).
  * 
- * @return Index of the first bit from right to left that is different between a and b.
+ * @return Index of the first bit from right to left that is different between a and b (k-1 if there is none after the fixed values).
  */
-int find_j(int* a, int* b, int n){
+int find_j(int* a, int* b, int n, int k){
     int j = n-2;
-    while(a[j] == b[j]){--j;}
+    while(j >= k && a[j] == b[j]){--j;}
     return j;
 }
\ No newline at end of file
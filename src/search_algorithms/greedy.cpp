@@ -1,8 +1,183 @@
 #include "search.h"
 
+/**
+ * Calculates the difference in log evidence between the merged and the separate components.
+ * 
+ * @param i                     Index of the first component.
+ * @param j                     Index of the second component.
+ * @param[in] partition         Current partition as a vector of n integers representing the components.
+ * @param[in, out] model        Struct containing the characteristic of the model (the evidence of new components is stored).
+ * 
+ * @return The difference in log evidence.
+ */
+double merge_difference(int i, int j, std::vector<__uint128_t>& partition, mcm& model){
+    double evidence_i = get_evidence_icc(partition[i], model);
+    double evidence_j = get_evidence_icc(partition[j], model);
+    return get_evidence_icc(partition[i] + partition[j], model) - evidence_i - evidence_j;
+}
+
+/**
+ * Comparing function that orders the candidate merges in the heap of the greedy search.
+ * 
+ * Ties are broken in favor of the pair that comes first in the order (i, j), as in a loop over all pairs.
+ * 
+ * @param[in] c1                Candidate merge.
+ * @param[in] c2                Candidate merge.
+ * 
+ * @return True if the first candidate is worse than the second one.
+ */
+bool comp_merge(const merge_candidate& c1, const merge_candidate& c2){
+    if (c1.evidence_diff != c2.evidence_diff){
+        return c1.evidence_diff < c2.evidence_diff;
+    }
+    if (c1.i != c2.i){
+        return c1.i > c2.i;
+    }
+    return c1.j > c2.j;
+}
+
+/**
+ * Prepares the labels of the components of a partition, if they fit in memory.
+ * 
+ * The labels of a component are only calculated when a merge with the component is evaluated by joining labels.
+ * 
+ * @param[in] partition         Partition as a vector of n integers representing the components (one entry of the labels per integer).
+ * @param[in, out] labels       Vector that will contain an empty entry for every component (empty if the labels do not fit in memory).
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void init_partition_labels(std::vector<__uint128_t>& partition, std::vector<component_labels>& labels, mcm& model){
+    labels.clear();
+    if ((double) partition.size() * model.data.n_states * sizeof(unsigned int) > max_label_bytes){
+        return;
+    }
+    labels.resize(partition.size());
+}
+
+/**
+ * Calculates in parallel the log evidence of the components and merged pairs of components that are not stored yet.
+ * 
+ * Merged components that are not counted with the bit-sliced view are evaluated by joining the labels of the two components.
+ * 
+ * @param[in] pairs             Pairs of indices of components (a pair (i, i) stands for component i itself).
+ * @param[in] partition         Current partition as a vector of n integers representing the components.
+ * @param[in] labels            Labels of the components (empty if they are not used).
+ * @param[in, out] model        Struct containing the characteristic of the model (the evidence of new components is stored).
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void evaluate_merges(std::vector<std::pair<int, int>>& pairs, std::vector<__uint128_t>& partition, std::vector<component_labels>& labels, mcm& model){
+    std::vector<__uint128_t> components;
+    std::vector<std::pair<int, int>> joins;
+    for (std::pair<int, int>& pair : pairs){
+        __uint128_t component = partition[pair.first] | partition[pair.second];
+        if (model.evidence_storage.count(component)){continue;}
+        if (pair.first != pair.second && !labels.empty() && !use_sliced_counts(model, component_size(component))){
+            joins.push_back(pair);
+        }
+        else{
+            components.push_back(component);
+        }
+    }
+    get_evidence_batch(components, model);
+
+    // Labels of the components that are joined (if they are not up to date)
+    std::vector<int> missing;
+    for (std::pair<int, int>& pair : joins){
+        for (int i : {pair.first, pair.second}){
+            if (labels[i].component != partition[i] && std::find(missing.begin(), missing.end(), i) == missing.end()){
+                missing.push_back(i);
+            }
+        }
+    }
+    parallel_for(missing.size(), [&](int k){
+        init_labels(model, partition[missing[k]], labels[missing[k]]);
+    });
+
+    std::vector<double> log_evidence(joins.size());
+    parallel_for(joins.size(), [&](int k){
+        log_evidence[k] = evidence_of_join(model, labels[joins[k].first], labels[joins[k].second]);
+    });
+    for (size_t k = 0; k < joins.size(); k++){
+        model.evidence_storage[partition[joins[k].first] | partition[joins[k].second]] = log_evidence[k];
+    }
+}
+
+/**
+ * Merges two components of a partition and their labels.
+ * 
+ * @param i                     Index of the component that will contain the merged component.
+ * @param j                     Index of the component that becomes empty.
+ * @param[in, out] partition    Current partition as a vector of n integers representing the components.
+ * @param[in, out] labels       Labels of the components (empty if they are not used).
+ * @param[in] model             Struct containing the characteristic of the model.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void merge_components(int i, int j, std::vector<__uint128_t>& partition, std::vector<component_labels>& labels, mcm& model){
+    if (!labels.empty()){
+        if (labels[i].component == partition[i] && labels[j].component == partition[j]){
+            // Both labels are up to date -> join them
+            component_labels joined;
+            evidence_of_join(model, labels[i], labels[j], &joined);
+            labels[i].labels.swap(joined.labels);
+            labels[i].n_labels = joined.n_labels;
+            labels[i].component = joined.component;
+        }
+        else{
+            labels[i] = component_labels();
+        }
+        labels[j] = component_labels();
+    }
+    partition[i] += partition[j];
+    partition[j] = 0;
+}
+
+/**
+ * Adds the merges of a component with all other components that increase the evidence to the heap of candidates.
+ * 
+ * @param i                     Index of the component.
+ * @param[in] partition         Current partition as a vector of n integers representing the components.
+ * @param[in] labels            Labels of the components (empty if they are not used).
+ * @param[in] version           Number of times every component has changed.
+ * @param[in, out] candidates   Heap with the candidate merges (best merge at the front).
+ * @param[in, out] model        Struct containing the characteristic of the model.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void add_merge_candidates(int i, std::vector<__uint128_t>& partition, std::vector<component_labels>& labels, std::vector<int>& version, std::vector<merge_candidate>& candidates, mcm& model){
+    // Evaluate the new components in parallel
+    std::vector<std::pair<int, int>> pairs(1, std::make_pair(i, i));
+    for (int j = 0; j < model.n; j++){
+        if (j != i && partition[j] != 0){
+            pairs.push_back(std::make_pair(i, j));
+        }
+    }
+    evaluate_merges(pairs, partition, labels, model);
+
+    for (int j = 0; j < model.n; j++){
+        // Skip empty components
+        if (j == i || partition[j] == 0){continue;}
+        int first = std::min(i, j);
+        int second = std::max(i, j);
+        double evidence_diff = merge_difference(first, second, partition, model);
+        // Merges that do not increase the evidence are never chosen (until one of the components changes)
+        if (evidence_diff > 0){
+            candidates.push_back({evidence_diff, first, second, version[first], version[second]});
+            std::push_heap(candidates.begin(), candidates.end(), comp_merge);
+        }
+    }
+}
+
 /**
  * Performs a greedy search to find an estimation of the best partition.
  * 
+ * The differences in evidence of all pairs of components are kept in a heap.
+ * After a merge, only the pairs with the merged component are calculated again, other entries that involve the merged components are skipped.
+ * The components of every step are evaluated in parallel before the differences are calculated.
+ * Every component keeps the label of its state for all states in the dataset, so merges are evaluated by joining two label arrays.
+ * 
  * @param[in, out] model        Struct containing the characteristic of the model. 
  *                              -'best_mcm[0]' will contain the partition with the largest evidence found by the algorithm.
  *                              -'evidence' will be the evidence of the partition found by the algorithm.
@@ -28,55 +203,138 @@ void greedy_search(mcm& model){
         print_partition_to_file(*model.greedy_file, partition);
     }
 
-    // Variables to store the calculated evidences
-    double evidence_i;
-    double evidence_j;
-    double evidence_diff;
+    // Evaluate all components of one or two variables in parallel
+    std::vector<component_labels> labels;
+    init_partition_labels(partition, labels, model);
+    std::vector<std::pair<int, int>> pairs;
+    for (int i = 0; i < model.n; i++){
+        for (int j = i; j < model.n; j++){
+            pairs.push_back(std::make_pair(i, j));
+        }
+    }
+    evaluate_merges(pairs, partition, labels, model);
+
+    // Differences in evidence of all pairs of components
+    std::vector<int> version(model.n, 0);
+    std::vector<merge_candidate> candidates;
+    for (int i = 0; i < model.n; i++){
+        for (int j = i+1; j < model.n; j++){
+            double evidence_diff = merge_difference(i, j, partition, model);
+            if (evidence_diff > 0){
+                candidates.push_back({evidence_diff, i, j, 0, 0});
+            }
+        }
+    }
+    std::make_heap(candidates.begin(), candidates.end(), comp_merge);
+
+    // Continue until no merge increases the evidence
+    while (!candidates.empty()){
+        merge_candidate best = candidates.front();
+        std::pop_heap(candidates.begin(), candidates.end(), comp_merge);
+        candidates.pop_back();
+        // Skip merges of components that have changed since the difference was calculated
+        if (best.version_i != version[best.i] || best.version_j != version[best.j]){continue;}
+
+        // Merge the two components that results in the biggest increase in evidence
+        merge_components(best.i, best.j, partition, labels, model);
+        version[best.i]++;
+        version[best.j]++;
+
+        // Write to file
+        if(model.log_file){
+            *model.greedy_file << "\nMerging componets " << best.i << " and " << best.j << " Evidence difference: "<<  best.evidence_diff << std::endl;
+            print_partition_to_file(*model.greedy_file, partition);
+        }
+
+        // Merges with the new component
+        add_merge_candidates(best.i, partition, labels, version, candidates, model);
+    }
+    // Store the best MCM and corresponding log evidence found using the greedy merging scheme
+    model.best_mcm.push_back(partition);
+    model.best_evidence = calc_evidence(partition, model);
+}
+/**
+ * Performs a greedy search that applies several merges in every iteration to find an estimation of the best partition.
+ * 
+ * In every iteration, the differences in evidence of all pairs of components are evaluated in parallel.
+ * Going from the largest to the smallest increase in evidence, every merge of two components that are not merged yet in this iteration is applied.
+ * On data with many independent modules, the number of iterations is of the order of log(n) instead of n.
+ * 
+ * @param[in, out] model        Struct containing the characteristic of the model. 
+ *                              -'best_mcm[0]' will contain the partition with the largest evidence found by the algorithm.
+ *                              -'evidence' will be the evidence of the partition found by the algorithm.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void batch_greedy_search(mcm& model){
+    model.exhaustive = false;
+
+    // Start from the independent model (n components of size 1)
+    std::vector<__uint128_t> partition(model.n, 0);
+    __uint128_t element = 1;
+    for (int i = 0; i < model.n; i++){
+        partition[i] += element;
+        element <<= 1;
+    }
 
-    // Variables to store the best values
-    int best_i;
-    int best_j;
-    double best_evidence_diff;
+    // Write to file
+    if(model.log_file){
+        *model.greedy_file << "Start batched greedy merging procedure \n" << std::endl;
+        print_partition_to_file(*model.greedy_file, partition);
+    }
 
+    std::vector<component_labels> labels;
+    init_partition_labels(partition, labels, model);
+    int iteration = 0;
     while (true){
-        best_evidence_diff = 0;
+        // Evaluate all components and merged pairs in parallel
+        std::vector<std::pair<int, int>> pairs;
+        for (int i = 0; i < model.n; i++){
+            if (partition[i] == 0){continue;}
+            for (int j = i; j < model.n; j++){
+                if (partition[j] == 0){continue;}
+                pairs.push_back(std::make_pair(i, j));
+            }
+        }
+        evaluate_merges(pairs, partition, labels, model);
+
+        // All merges that increase the evidence, from the largest to the smallest increase
+        std::vector<merge_candidate> candidates;
         for (int i = 0; i < model.n; i++){
-            // Skip empty components
             if (partition[i] == 0){continue;}
-            evidence_i = get_evidence_icc(partition[i], model);
             for (int j = i+1; j < model.n; j++){
-                // Skip empty components
                 if (partition[j] == 0){continue;}
-                evidence_j = get_evidence_icc(partition[j], model);
-                // Calculate difference in evidence between merged and separate partitions
-                evidence_diff = get_evidence_icc(partition[i] + partition[j], model) - evidence_i - evidence_j;
-                // Check if the difference is the best merge so far
-                if (evidence_diff > best_evidence_diff){
-                    // Update the largest increase in evidence
-                    best_evidence_diff = evidence_diff;
-                    // Keep track of the components that resulted in the largest increase
-                    best_i = i;
-                    best_j = j;
+                double evidence_diff = merge_difference(i, j, partition, model);
+                if (evidence_diff > 0){
+                    candidates.push_back({evidence_diff, i, j, 0, 0});
                 }
             }
         }
-        // Stop the algorithm if the evidence did not increase
-        if (best_evidence_diff == 0){
+        // Stop the algorithm if no merge increases the evidence
+        if (candidates.empty()){
             break;
         }
-        else{
-            // Merge the two components that results in the biggest increase in evidence
-            partition[best_i] += partition[best_j];
-            partition[best_j] = 0;
+        std::sort(candidates.begin(), candidates.end(), [](const merge_candidate& c1, const merge_candidate& c2){return comp_merge(c2, c1);});
+
+        // Apply the merges of components that are not merged yet in this iteration
+        ++iteration;
+        std::vector<bool> merged(model.n, false);
+        for (merge_candidate& candidate : candidates){
+            if (merged[candidate.i] || merged[candidate.j]){continue;}
+            merged[candidate.i] = true;
+            merged[candidate.j] = true;
+            merge_components(candidate.i, candidate.j, partition, labels, model);
 
             // Write to file
             if(model.log_file){
-                *model.greedy_file << "\nMerging componets " << best_i << " and " << best_j << " Evidence difference: "<<  best_evidence_diff << std::endl;
-                print_partition_to_file(*model.greedy_file, partition);
+                *model.greedy_file << "\nIteration " << iteration << ": merging componets " << candidate.i << " and " << candidate.j << " Evidence difference: "<<  candidate.evidence_diff << std::endl;
             }
         }
+        if(model.log_file){
+            print_partition_to_file(*model.greedy_file, partition);
+        }
     }
-    // Store the best MCM and corresponding log evidence found using the greedy merging scheme
+    // Store the best MCM and corresponding log evidence found using the batched merging scheme
     model.best_mcm.push_back(partition);
     model.best_evidence = calc_evidence(partition, model);
-}
\ No newline at end of file
+}
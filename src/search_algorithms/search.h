@@ -1,15 +1,286 @@
 #include "../model/model.h"
 
+/**
+ * Best partitions found in one work unit of the exhaustive search.
+ * 
+ * @struct unit_result
+ * 
+ * @var unit_result::best_evidence
+ *  Largest log evidence found in the work unit
+ * 
+ * @var unit_result::best_mcm
+ *  Partitions with a log evidence within the tolerance of the largest log evidence found so far (in the order of enumeration)
+ * 
+ * @var unit_result::evidence
+ *  Log evidence of the partitions in 'best_mcm'
+ * 
+ * @var unit_result::histogram
+ *  Histogram of the log evidence of all partitions in the work unit (only if the bin width of the model's histogram is set)
+ * 
+ * @var unit_result::top_mcm
+ *  Partitions with the largest log evidence in the work unit (only if the number of partitions in the model's list is set)
+ */
+struct unit_result {
+    double best_evidence = -DBL_MAX;
+    std::vector<std::vector<__uint128_t>> best_mcm;
+    std::vector<double> evidence;
+    evidence_histogram histogram;
+    top_partitions top_mcm;
+};
+
+/**
+ * Progress of an exhaustive search, which is stored in a checkpoint file.
+ * 
+ * @struct search_progress
+ * 
+ * @var search_progress::k
+ *  Number of fixed values of the restricted growth string in a work unit
+ * 
+ * @var search_progress::n_shards
+ *  Number of shards the work units are divided over (1 if the search is not sharded)
+ * 
+ * @var search_progress::done
+ *  For every work unit (in lexicographic order of the prefixes) if it is already processed
+ * 
+ * @var search_progress::result
+ *  Merged results of the work units that are already processed
+ */
+struct search_progress {
+    int k = 0;
+    int n_shards = 1;
+    std::vector<char> done;
+    unit_result result;
+};
+
+/**
+ * Header of a checkpoint file of the exhaustive search.
+ * 
+ * The header is followed by the done flag of every work unit, the best partitions with their log evidence,
+ * the histogram and the list of the best partitions.
+ */
+struct checkpoint_header {
+    char magic[4];
+    uint32_t version;
+    int32_t n;
+    int32_t q;
+    int64_t N;
+    uint64_t checksum;
+    int32_t k;
+    int32_t shard;
+    int32_t n_shards;
+    int32_t reserved;
+    uint64_t n_units;
+};
+
+/**
+ * State of the enumeration of the partitions in a work unit of the exhaustive search.
+ * 
+ * @struct partition_walk
+ * 
+ * @var partition_walk::model
+ *  Model for which the search is done (the evidence of all components should be stored)
+ * 
+ * @var partition_walk::result
+ *  Best partitions found in the work unit
+ * 
+ * @var partition_walk::a
+ *  Current partition as a restricted growth string
+ * 
+ * @var partition_walk::forward
+ *  Direction in which the values of every variable are visited next
+ * 
+ * @var partition_walk::partition
+ *  Current partition as a vector of n integers representing the components
+ * 
+ * @var partition_walk::log_evidence
+ *  Log evidence of the current partition (updated with every move)
+ * 
+ * @var partition_walk::error_bound
+ *  Bound on the rounding error in 'log_evidence' (grows with every move, reset when it is recalculated)
+ * 
+ * @var partition_walk::n_visited
+ *  Number of partitions visited so far
+ */
+struct partition_walk {
+    mcm* model;
+    unit_result* result;
+    std::vector<int> a;
+    std::vector<bool> forward;
+    std::vector<__uint128_t> partition;
+    double log_evidence;
+    double error_bound = 0;
+    uint64_t n_visited = 0;
+};
+
+/**
+ * State of the branch and bound search.
+ * 
+ * @struct bound_search
+ * 
+ * @var bound_search::model
+ *  Model for which the search is done (the evidence of all components should be stored)
+ * 
+ * @var bound_search::bounds
+ *  Level i contains for every set of the first i variables the largest log evidence of a component that extends it with variables i to n-1
+ * 
+ * @var bound_search::partition
+ *  Current (partial) partition as a vector of n integers representing the components
+ * 
+ * @var bound_search::best_evidence
+ *  Largest log evidence found so far
+ * 
+ * @var bound_search::best_mcm
+ *  Partitions with a log evidence within the tolerance of the largest log evidence found so far
+ * 
+ * @var bound_search::evidence
+ *  Log evidence of the partitions in 'best_mcm'
+ */
+struct bound_search {
+    mcm* model;
+    std::vector<std::vector<double>> bounds;
+    std::vector<__uint128_t> partition;
+    double best_evidence;
+    std::vector<std::vector<__uint128_t>> best_mcm;
+    std::vector<double> evidence;
+};
+
+/**
+ * Candidate merge of two components in the greedy search.
+ * 
+ * @struct merge_candidate
+ * 
+ * @var merge_candidate::evidence_diff
+ *  Difference in log evidence between the merged and the separate components
+ * 
+ * @var merge_candidate::i
+ *  Index of the first component (i < j)
+ * 
+ * @var merge_candidate::j
+ *  Index of the second component
+ * 
+ * @var merge_candidate::version_i
+ *  Number of times component i had changed when the difference was calculated
+ * 
+ * @var merge_candidate::version_j
+ *  Number of times component j had changed when the difference was calculated
+ */
+struct merge_candidate {
+    double evidence_diff;
+    int i;
+    int j;
+    int version_i;
+    int version_j;
+};
+
+// Kind of step in the split of a component (for the log file of divide and conquer)
+enum split_step_type {start_moving, intermediate_split, new_best_split};
+
+/**
+ * Step in the split of a component during divide and conquer, which is written to the log file afterwards.
+ * 
+ * @struct split_step
+ * 
+ * @var split_step::type
+ *  Start of a round of moves, new best move in the round or new best split
+ * 
+ * @var split_step::component_1
+ *  Component from which the variables are moved after the step
+ * 
+ * @var split_step::component_2
+ *  Component to which the variables are moved after the step
+ * 
+ * @var split_step::variable
+ *  Index of the variable that is moved (only for a new best move)
+ * 
+ * @var split_step::evidence_diff
+ *  Difference in log evidence with the unsplit component (only for a new best move)
+ */
+struct split_step {
+    split_step_type type;
+    __uint128_t component_1;
+    __uint128_t component_2;
+    int variable;
+    double evidence_diff;
+};
+
+/**
+ * Node in the recursion of divide and conquer.
+ * 
+ * @struct split_node
+ * 
+ * @var split_node::component
+ *  Component that is split
+ * 
+ * @var split_node::storage
+ *  Log evidence of the components evaluated in this node and its parts
+ * 
+ * @var split_node::steps
+ *  Steps of the split for the log file
+ * 
+ * @var split_node::parts
+ *  Recursive divisions of the two parts of the split (empty if no split increases the evidence)
+ */
+struct split_node {
+    __uint128_t component;
+    std::map<__uint128_t, double> storage;
+    std::vector<split_step> steps;
+    std::vector<split_node> parts;
+};
+
+// Partitions with a log evidence that differs less than this value are considered equivalent
+const double evidence_tolerance = 1E-6;
+// Extra margin on the running log evidence before a partition is recalculated exactly (on top of its rounding error)
+const double screening_margin = 1E-6;
+
 // Search algorithms
 void exhaustive_search(mcm& model);
+void subset_dp_search(mcm& model);
+void branch_and_bound_search(mcm& model);
 void greedy_search(mcm& model);
+void batch_greedy_search(mcm& model);
 void divide_and_conquer(mcm&model);
 
 // Helper functions for exhaustive search
-int find_j(int* a, int* b, int n);
-int generate_next_partition(int* a, int* b, int n);
+int find_j(int* a, int* b, int n, int k=1);
+int generate_next_partition(int* a, int* b, int n, int k=1);
+double stored_evidence(__uint128_t component, mcm& model);
+void move_variable(partition_walk& walk, int i, int to);
+void resync_evidence(partition_walk& walk);
+void visit_partition(partition_walk& walk);
+void gray_enumeration(partition_walk& walk, int i, int m);
+void exhaustive_unit(int* prefix, int k, mcm& model, unit_result& result);
+void merge_unit_result(unit_result& total, const unit_result& result);
+double bell_number(int k);
+int unit_prefix_length(int n, double min_units);
+
+// Checkpoints of the exhaustive search
+bool write_checkpoint_file(std::string file, checkpoint_header& header, search_progress& progress);
+bool write_checkpoint(std::string file, mcm& model, search_progress& progress);
+bool read_checkpoint_file(std::string file, checkpoint_header& header, search_progress& progress);
+bool read_checkpoint(std::string file, mcm& model, search_progress& progress);
+
+// Helper functions for the dynamic programming search
+double best_split(uint64_t set, mcm& model, std::vector<double>& best);
+void collect_best_partitions(uint64_t set, double log_evidence, std::vector<__uint128_t>& partition, int n_components, mcm& model, std::vector<double>& best);
+bool comp_rgs(const std::vector<__uint128_t>& partition1, const std::vector<__uint128_t>& partition2);
+
+// Helper functions for the branch and bound search
+void calc_component_bounds(mcm& model, std::vector<std::vector<double>>& bounds);
+double partition_bound(bound_search& search, int i, int n_components);
+void branch(bound_search& search, int i, int n_components);
+
+// Helper functions for the greedy search
+double merge_difference(int i, int j, std::vector<__uint128_t>& partition, mcm& model);
+bool comp_merge(const merge_candidate& c1, const merge_candidate& c2);
+void init_partition_labels(std::vector<__uint128_t>& partition, std::vector<component_labels>& labels, mcm& model);
+void evaluate_merges(std::vector<std::pair<int, int>>& pairs, std::vector<__uint128_t>& partition, std::vector<component_labels>& labels, mcm& model);
+void merge_components(int i, int j, std::vector<__uint128_t>& partition, std::vector<component_labels>& labels, mcm& model);
+void add_merge_candidates(int i, std::vector<__uint128_t>& partition, std::vector<component_labels>& labels, std::vector<int>& version, std::vector<merge_candidate>& candidates, mcm& model);
 
 // Helper functions for divide and conquer
-int division(int move_from, int move_to, mcm& model);
+void split_component(split_node& node, mcm& model);
+void evaluate_moves(__uint128_t component_1, __uint128_t component_2, std::vector<__uint128_t>& members, mcm& model, std::map<__uint128_t, double>& storage);
+void division(split_node& node, mcm& model);
+int assemble_partition(split_node& node, int move_from, int move_to, std::vector<__uint128_t>& partition, mcm& model);
 __uint128_t find_member_i(__uint128_t community, int i);
 int index_of_member(__uint128_t member);
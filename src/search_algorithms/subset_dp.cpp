@@ -0,0 +1,131 @@
+#include "search.h"
+
+/**
+ * Finds the best way to split off the component that contains the lowest variable of a set.
+ * 
+ * @param set                   Integer representation of the bitstring representing a set of variables.
+ * @param[in] model             Struct containing the characteristic of the model (the evidence of all components should be stored).
+ * @param[in] best              Vector with the largest log evidence of every set with fewer variables.
+ * 
+ * @return The largest log evidence of a partition of the set.
+ */
+double best_split(uint64_t set, mcm& model, std::vector<double>& best){
+    uint64_t lowest = set & (~set + 1);
+    uint64_t rest = set ^ lowest;
+    double best_evidence = -DBL_MAX;
+    // Loop over all subsets of the other variables (including the empty set)
+    uint64_t subset = rest;
+    while (true){
+        uint64_t component = subset | lowest;
+        double log_evidence = model.evidence_storage_es[component-1] + best[set ^ component];
+        best_evidence = std::max(best_evidence, log_evidence);
+        if (subset == 0){break;}
+        subset = (subset - 1) & rest;
+    }
+    return best_evidence;
+}
+
+/**
+ * Collects all partitions of a set that complete a partial partition to one of the best partitions.
+ * 
+ * @param set                   Integer representation of the bitstring representing the variables that are not assigned yet.
+ * @param log_evidence          Log evidence of the components that are already assigned.
+ * @param[in, out] partition    Partial partition, components are added in the order of their lowest variable.
+ * @param n_components          Number of components that are already assigned.
+ * @param[in, out] model        Struct containing the characteristic of the model.
+ *                              -'best_mcm' will contain all best partitions.
+ * @param[in] best              Vector with the largest log evidence of every set of variables.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void collect_best_partitions(uint64_t set, double log_evidence, std::vector<__uint128_t>& partition, int n_components, mcm& model, std::vector<double>& best){
+    if (set == 0){
+        // Complete partition
+        model.best_mcm.push_back(partition);
+        return;
+    }
+    uint64_t lowest = set & (~set + 1);
+    uint64_t rest = set ^ lowest;
+    uint64_t subset = rest;
+    while (true){
+        uint64_t component = subset | lowest;
+        double ev_component = model.evidence_storage_es[component-1];
+        // Only continue if the best completion is within the tolerance of the best log evidence
+        if (log_evidence + ev_component + best[set ^ component] > model.best_evidence - evidence_tolerance){
+            partition[n_components] = component;
+            collect_best_partitions(set ^ component, log_evidence + ev_component, partition, n_components + 1, model, best);
+            partition[n_components] = 0;
+        }
+        if (subset == 0){break;}
+        subset = (subset - 1) & rest;
+    }
+}
+
+/**
+ * Comparing function that orders partitions in the same way as they are generated in the exhaustive search (restricted growth strings).
+ * 
+ * @param[in] partition1        Partition as a vector of n integers, components in the order of their lowest variable.
+ * @param[in] partition2        Partition as a vector of n integers, components in the order of their lowest variable.
+ * 
+ * @return True if the restricted growth string of the first partition comes first.
+ */
+bool comp_rgs(const std::vector<__uint128_t>& partition1, const std::vector<__uint128_t>& partition2){
+    int n = partition1.size();
+    for (int i = 0; i < n; ++i){
+        // Index of the component that contains variable i
+        int a1 = 0;
+        int a2 = 0;
+        while (!((partition1[a1] >> i) & 1)){++a1;}
+        while (!((partition2[a2] >> i) & 1)){++a2;}
+        if (a1 != a2){
+            return a1 < a2;
+        }
+    }
+    return false;
+}
+
+/**
+ * Finds the best partition with dynamic programming over the subsets of the variables.
+ * 
+ * The best partition of a set S is the best combination of a component containing the lowest variable of S
+ * and the best partition of the remaining variables, which takes O(3^n) steps instead of going through all Bell(n) partitions.
+ * 
+ * @param[in, out] model        Struct containing the characteristic of the model.
+ *                              -'best_mcm' will contain all partitions with the largest evidence (same order as the exhaustive search).
+ *                              -'evidence' will be the evidence of the partition(s) found by the algorithm.
+ * 
+ * @return void                 Nothing is returned by this function.
+ */
+void subset_dp_search(mcm& model){
+    // Reset best mcm in case another search has been ran previously
+    model.best_mcm.clear();
+    model.best_evidence = -DBL_MAX;
+    if (model.n > 30){
+        std::cout << "Too many variables for the dynamic programming search. Maximum system size is 30." << std::endl;
+        return;
+    }
+
+    // Calculate the evidence of all components (2^n - 1 iccs)
+    calc_all_evidence_icc(model);
+
+    // Largest log evidence of a partition of every set of variables
+    uint64_t n_sets = (uint64_t) 1 << model.n;
+    std::vector<double> best(n_sets, 0);
+    int n_blocks = std::min((uint64_t) 4096, n_sets);
+    // Sets with the same number of variables only depend on smaller sets -> calculate them in parallel
+    for (int size = 1; size <= model.n; ++size){
+        parallel_for(n_blocks, [&](int block){
+            for (uint64_t set = block; set < n_sets; set += n_blocks){
+                if (__builtin_popcountll(set) == size){
+                    best[set] = best_split(set, model, best);
+                }
+            }
+        });
+    }
+    model.best_evidence = best[n_sets - 1];
+
+    // Reconstruct all partitions with the largest evidence
+    std::vector<__uint128_t> partition(model.n, 0);
+    collect_best_partitions(n_sets - 1, 0, partition, 0, model, best);
+    std::sort(model.best_mcm.begin(), model.best_mcm.end(), comp_rgs);
+}
@@ -4,33 +4,184 @@
 TEST(data, read_in){
     int n = 3;
     // Read in data
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test.dat", n, 2);
+    dataset data = data_processing("../tests/test.dat", n, 2);
 
     // Check the number of observations
-    EXPECT_EQ(data.size(), 7);
+    EXPECT_EQ(data.n_states, 7);
 
-    // Check the number of variables
-    for(std::vector<__uint128_t> obs : data){
-        EXPECT_EQ(obs.size(), 2);
-    }
+    // Check the number of integers per observation
+    EXPECT_EQ(data.n_ints, 2);
+
+    // Check the alignment of the buffer
+    EXPECT_EQ((size_t) data.states % 64, 0);
 
     // Check individual observations
     std::vector<__uint128_t> obs = {2,1};
-    EXPECT_EQ(data[0], obs);
-    EXPECT_EQ(data[5], obs);
+    EXPECT_EQ(get_state(data, 0), obs);
+    EXPECT_EQ(get_state(data, 5), obs);
     
     obs = {0,1};
-    EXPECT_EQ(data[1], obs);
+    EXPECT_EQ(get_state(data, 1), obs);
 
     obs = {1,2};
-    EXPECT_EQ(data[2], obs);
+    EXPECT_EQ(get_state(data, 2), obs);
 
     obs = {6,1};
-    EXPECT_EQ(data[3], obs);
+    EXPECT_EQ(get_state(data, 3), obs);
 
     obs = {7,0};
-    EXPECT_EQ(data[4], obs);
+    EXPECT_EQ(get_state(data, 4), obs);
+
+    obs = {2,4};
+    EXPECT_EQ(get_state(data, 6), obs);
+}
+
+TEST(data, unique_states){
+    int n = 3;
+    mcm model = create_model(3, n, false);
+    // Read in data
+    dataset data = data_processing("../tests/test.dat", n, model.n_ints);
+    load_data(model, data);
+
+    // Observation 0 and 5 are the same
+    EXPECT_EQ(model.N, 7);
+    EXPECT_EQ(model.data.n_states, 6);
+
+    // States are stored in order of first occurrence
+    std::vector<__uint128_t> obs = {2,1};
+    EXPECT_EQ(get_state(model.data, 0), obs);
+    EXPECT_EQ(model.data.weights[0], 2);
+
+    obs = {0,1};
+    EXPECT_EQ(get_state(model.data, 1), obs);
+    EXPECT_EQ(model.data.weights[1], 1);
 
     obs = {2,4};
-    EXPECT_EQ(data[6], obs);
+    EXPECT_EQ(get_state(model.data, 5), obs);
+    EXPECT_EQ(model.data.weights[5], 1);
+}
+
+TEST(data, number_of_observations){
+    // The total number of observations should fit in N
+    mcm model = create_model(2, 3, false);
+    dataset data;
+    allocate_dataset(data, 2, 1);
+    data.states[0] = 1;
+    data.states[1] = 2;
+    data.weights[0] = 2147483647u;
+    data.weights[1] = 5;
+    EXPECT_FALSE(load_data(model, data));
+    data.weights[0] = 2147483642u;
+    EXPECT_TRUE(load_data(model, data));
+    EXPECT_EQ(model.N, 2147483647);
+}
+
+TEST(data, malformed_lines){
+    // Line 2 is too short, line 4 contains a value that is too large for q = 3 -> both are skipped
+    std::ofstream file("malformed.dat");
+    file << "210\n21\n120\n213\n000\n";
+    file.close();
+
+    dataset data = data_processing("malformed.dat", 3, 2, 3);
+    EXPECT_EQ(data.n_states, 3);
+    std::vector<__uint128_t> obs = {1,2};
+    EXPECT_EQ(get_state(data, 1), obs);
+
+    // Empty lines are skipped, a file without valid observations is rejected
+    file.open("malformed.dat");
+    file << "210\n\n120\r\n\n";
+    file.close();
+    data = data_processing("malformed.dat", 3, 2, 3);
+    EXPECT_EQ(data.n_states, 2);
+    file.open("malformed.dat");
+    file << "21\n\n";
+    file.close();
+    data = data_processing("malformed.dat", 3, 2, 3);
+    EXPECT_EQ(data.n_states, 0);
+
+    // Values up to 3 fit in 2 bits when q is not given
+    file.open("malformed.dat");
+    file << "210\n213\r\n000\n";
+    file.close();
+
+    data = data_processing("malformed.dat", 3, 2);
+    EXPECT_EQ(data.n_states, 3);
+    obs = {6,5};
+    EXPECT_EQ(get_state(data, 1), obs);
+    std::remove("malformed.dat");
+}
+
+TEST(data, parallel_read_in){
+    // File that is large enough to be split into several chunks
+    int n_obs = 300000;
+    std::ofstream file("large.dat");
+    for (int i = 0; i < n_obs; ++i){
+        file << (i % 3) << ((i / 3) % 3) << ((i / 9) % 3) << '\n';
+    }
+    file.close();
+
+    set_num_threads(4);
+    dataset data = data_processing("large.dat", 3, 2, 3);
+    set_num_threads(0);
+    std::remove("large.dat");
+
+    EXPECT_EQ(data.n_states, n_obs);
+    // Check that every observation is stored at the correct position
+    int n_wrong = 0;
+    for (int i = 0; i < n_obs; ++i){
+        std::vector<int> state = {i % 3, (i / 3) % 3, (i / 9) % 3};
+        if (get_state(data, i) != convert_representation(state, 3, 2)){
+            ++n_wrong;
+        }
+    }
+    EXPECT_EQ(n_wrong, 0);
+}
+
+TEST(data, binary_format){
+    mcm model = create_model(3, 3, false);
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
+    EXPECT_TRUE(write_binary("test.mcmb", model));
+
+    // Read the binary file into a new model
+    mcm binary_model = create_model(3, 3, false);
+    EXPECT_TRUE(read_binary("test.mcmb", binary_model));
+    EXPECT_EQ(binary_model.N, 7);
+    EXPECT_EQ(binary_model.data.n_states, 6);
+    EXPECT_EQ((size_t) binary_model.data.states % 64, 0);
+    for (int i = 0; i < 6; ++i){
+        EXPECT_EQ(get_state(binary_model.data, i), get_state(model.data, i));
+        EXPECT_EQ(binary_model.data.weights[i], model.data.weights[i]);
+    }
+    EXPECT_EQ(data_checksum(binary_model.data), data_checksum(model.data));
+
+    // Dataset with a different number of variables
+    mcm other_model = create_model(3, 4, false);
+    EXPECT_FALSE(read_binary("test.mcmb", other_model));
+
+    // Number of observations in the header that does not match the weights
+    std::fstream file("test.mcmb", std::ios::in | std::ios::out | std::ios::binary);
+    uint64_t N = 8;
+    file.seekp(24);
+    file.write((const char*) &N, sizeof(N));
+    file.close();
+    EXPECT_FALSE(read_binary("test.mcmb", binary_model));
+
+    // Corrupted file
+    EXPECT_TRUE(write_binary("test.mcmb", model));
+    file.open("test.mcmb", std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(64);
+    file.put(7);
+    file.close();
+    binary_model = create_model(3, 3, false);
+    EXPECT_FALSE(read_binary("test.mcmb", binary_model));
+
+    // Number of states in the header for which the size of the buffer overflows
+    file.open("test.mcmb", std::ios::in | std::ios::out | std::ios::binary);
+    uint64_t n_states = ((uint64_t) 1 << 62) + 1;
+    file.seekp(32);
+    file.write((const char*) &n_states, sizeof(n_states));
+    file.close();
+    EXPECT_FALSE(read_binary("test.mcmb", binary_model));
+    std::remove("test.mcmb");
 }
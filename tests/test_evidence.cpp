@@ -5,79 +5,144 @@
 TEST(evidence, count_obs){
     // Read in test data + create model
     mcm model = create_model(3, 3, false);
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test.dat", 3, model.n_ints);
-    model.data = data;
-    model.N = data.size();
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
 
 
-    std::map<std::vector<__uint128_t>, unsigned int> counts;
+    count_table counts;
     std::vector<__uint128_t> key = {0,0};
     // Component = 1
-    counts = count_observations(model, 1);
-    EXPECT_EQ(counts.size(), 3);
-    EXPECT_EQ(counts[key], 1);
+    count_observations(model, 1, counts);
+    EXPECT_EQ(counts.occupied.size(), 3);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
     key = {1,0};
-    EXPECT_EQ(counts[key], 2);
+    EXPECT_EQ(table_count(counts, key.data()), 2);
     key = {0,1};
-    EXPECT_EQ(counts[key], 4);
+    EXPECT_EQ(table_count(counts, key.data()), 4);
     
     // Component = 2
-    counts = count_observations(model, 2);
-    EXPECT_EQ(counts.size(), 3);
+    count_observations(model, 2, counts);
+    EXPECT_EQ(counts.occupied.size(), 3);
     key = {0,0};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
     key = {2,0};
-    EXPECT_EQ(counts[key], 5);
+    EXPECT_EQ(table_count(counts, key.data()), 5);
     key = {0,2};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
 
     // Component = 4
-    counts = count_observations(model, 4);
-    EXPECT_EQ(counts.size(), 3);
+    count_observations(model, 4, counts);
+    EXPECT_EQ(counts.occupied.size(), 3);
     key = {0,0};
-    EXPECT_EQ(counts[key], 4);
+    EXPECT_EQ(table_count(counts, key.data()), 4);
     key = {4,0};
-    EXPECT_EQ(counts[key], 2);
+    EXPECT_EQ(table_count(counts, key.data()), 2);
     key = {0,4};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
 
     // Component = 3
-    counts = count_observations(model, 3);
-    EXPECT_EQ(counts.size(), 5);
+    count_observations(model, 3, counts);
+    EXPECT_EQ(counts.occupied.size(), 5);
     key = {0,1};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
     key = {1,2};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
     key = {3,0};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
     key = {2,1};
-    EXPECT_EQ(counts[key], 3);
+    EXPECT_EQ(table_count(counts, key.data()), 3);
     key = {2,0};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
 
     // Component = 7
-    counts = count_observations(model, 7);
-    EXPECT_EQ(counts.size(), 6);
+    count_observations(model, 7, counts);
+    EXPECT_EQ(counts.occupied.size(), 6);
     key = {0,1};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
     key = {2,1};
-    EXPECT_EQ(counts[key], 2);
+    EXPECT_EQ(table_count(counts, key.data()), 2);
     key = {1,2};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
     key = {6,1};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
     key = {7,0};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
     key = {2,4};
-    EXPECT_EQ(counts[key], 1);
+    EXPECT_EQ(table_count(counts, key.data()), 1);
+}
+
+TEST(evidence, count_table){
+    count_table table;
+    reset_table(table, 2);
+    EXPECT_EQ(table.occupied.size(), 0);
+
+    // Insert more keys than the initial number of slots to force the table to grow
+    std::vector<__uint128_t> key(2);
+    for (int i = 0; i < 5000; ++i){
+        key[0] = i % 2500;
+        key[1] = ((__uint128_t) 1 << 100) + i % 2500;
+        add_to_table(table, key.data(), i + 1);
+    }
+    EXPECT_EQ(table.occupied.size(), 2500);
+    for (int i = 0; i < 2500; ++i){
+        key[0] = i;
+        key[1] = ((__uint128_t) 1 << 100) + i;
+        EXPECT_EQ(table_count(table, key.data()), 2 * i + 2502) << "Wrong count for key " << i;
+    }
+    // Keys are iterated in order of insertion
+    EXPECT_EQ(table.keys[table.occupied[3] * 2], 3);
+
+    // Reusing the table removes all keys
+    reset_table(table, 2);
+    EXPECT_EQ(table.occupied.size(), 0);
+    EXPECT_EQ(table_count(table, key.data()), 0);
+}
+
+TEST(evidence, extract_bits){
+    bit_extractor extractor;
+
+    init_extractor(extractor, 5);
+    EXPECT_EQ(extract_bits(extractor, 0), 0);
+    EXPECT_EQ(extract_bits(extractor, 1), 1);
+    EXPECT_EQ(extract_bits(extractor, 2), 0);
+    EXPECT_EQ(extract_bits(extractor, 4), 2);
+    EXPECT_EQ(extract_bits(extractor, 7), 3);
+
+    // Component spread over both 64bit halves
+    __uint128_t component = ((__uint128_t) 3 << 126) + ((__uint128_t) 1 << 70) + (1 << 9) + 1;
+    init_extractor(extractor, component);
+    EXPECT_EQ(extract_bits(extractor, component), 31);
+    EXPECT_EQ(extract_bits(extractor, ~component), 0);
+    EXPECT_EQ(extract_bits(extractor, (__uint128_t) 1 << 127), 16);
+    EXPECT_EQ(extract_bits(extractor, ((__uint128_t) 1 << 70) + 1), 5);
+}
+
+TEST(evidence, dense_counts){
+    // Read in test data + create model
+    mcm model = create_model(3, 3, false);
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
+
+    // 2^(2*1) cells for a single variable, 2^(2*3) cells for all three variables
+    EXPECT_TRUE(use_dense_counts(model, 1));
+    EXPECT_FALSE(use_dense_counts(model, 3));
+
+    // Component = 3 -> index is (bits in plane 0) + 4 * (bits in plane 1)
+    std::vector<unsigned int> counts;
+    count_observations_dense(model, 3, 2, counts);
+    EXPECT_EQ(counts.size(), 16);
+    EXPECT_EQ(counts[0 + 4 * 1], 1);
+    EXPECT_EQ(counts[1 + 4 * 2], 1);
+    EXPECT_EQ(counts[3 + 4 * 0], 1);
+    EXPECT_EQ(counts[2 + 4 * 1], 3);
+    EXPECT_EQ(counts[2 + 4 * 0], 1);
 }
 
 TEST(evidence, icc){
     // Read in test data + create model
     mcm model = create_model(3, 3, false);
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test.dat", 3, model.n_ints);
-    model.data = data;
-    model.N = data.size();
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
 
     EXPECT_FLOAT_EQ(calc_evidence_icc(1, model, 1), -8.769507120030227);
     EXPECT_FLOAT_EQ(calc_evidence_icc(2, model, 1), -7.670894831362117);
@@ -89,9 +154,8 @@ TEST(evidence, icc){
 TEST(evidence, total){
     // Read in test data + create model
     mcm model = create_model(3, 3, false);
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test.dat", 3, model.n_ints);
-    model.data = data;
-    model.N = data.size();
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
     model.exhaustive = true;
 
     // Create storage
@@ -110,9 +174,8 @@ TEST(evidence, total){
 TEST(evidence, storage){
     // Read in test data + create model
     mcm model = create_model(3, 3, false);
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test.dat", 3, model.n_ints);
-    model.data = data;
-    model.N = data.size();
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
     model.exhaustive = false;
 
     // Calculate the log-evidence of 1 component
@@ -126,3 +189,274 @@ TEST(evidence, storage){
     EXPECT_EQ(model.evidence_storage.size(), 2);
     EXPECT_EQ(model.evidence_storage[7], calc_evidence_icc(7, model, 3));    
 }
+
+TEST(evidence, storage_batch){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+    model.exhaustive = false;
+    get_evidence_icc(3, model);
+
+    // Batch with duplicates and a component that is already stored
+    std::vector<__uint128_t> components = {3, 5, 1023, 5, 96, 1};
+    get_evidence_batch(components, model);
+
+    EXPECT_EQ(model.evidence_storage.size(), 5);
+    for (__uint128_t component : components){
+        EXPECT_EQ(model.evidence_storage[component], calc_evidence_icc(component, model, component_size(component)));
+    }
+}
+
+TEST(evidence, derived_counts){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+
+    // Component without variable 2, derived from the counts of the component
+    count_table counts;
+    count_table marginal;
+    count_observations(model, 45, counts);
+    marginalize_table(counts, 4, marginal);
+    EXPECT_FLOAT_EQ(evidence_from_table(marginal, 3, model), calc_evidence_icc(41, model, 3));
+
+    // Component without variables 2 and 5 at once
+    count_table expected;
+    count_observations(model, 9, expected);
+    marginalize_table(counts, 36, marginal);
+    EXPECT_EQ(marginal.occupied.size(), expected.occupied.size());
+    for (unsigned int slot : expected.occupied){
+        EXPECT_EQ(table_count(marginal, &expected.keys[(size_t) slot * expected.n_ints]), expected.counts[slot]);
+    }
+    EXPECT_FLOAT_EQ(evidence_from_table(marginal, 2, model), calc_evidence_icc(9, model, 2));
+
+    // Component with variable 9, derived from the labels of the states of the component
+    std::vector<unsigned int> labels;
+    int n_labels = label_observations(model, 45, labels);
+    EXPECT_EQ(n_labels, counts.occupied.size());
+    EXPECT_FLOAT_EQ(evidence_of_extension(model, labels, n_labels, 512, 5), calc_evidence_icc(557, model, 5));
+
+    // Extension of the empty component
+    n_labels = label_observations(model, 0, labels);
+    EXPECT_EQ(n_labels, 1);
+    EXPECT_FLOAT_EQ(evidence_of_extension(model, labels, n_labels, 8, 1), calc_evidence_icc(8, model, 1));
+}
+
+TEST(evidence, label_join){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+
+    component_labels labels_1;
+    component_labels labels_2;
+    component_labels joined;
+    init_labels(model, 7, labels_1);
+    init_labels(model, 8, labels_2);
+    EXPECT_FLOAT_EQ(evidence_of_join(model, labels_1, labels_2), calc_evidence_icc(15, model, 4));
+
+    // The labels of the union can be joined again
+    EXPECT_FLOAT_EQ(evidence_of_join(model, labels_1, labels_2, &joined), calc_evidence_icc(15, model, 4));
+    EXPECT_EQ(joined.component, 15);
+    init_labels(model, 1008, labels_2);
+    EXPECT_FLOAT_EQ(evidence_of_join(model, joined, labels_2), calc_evidence_icc(1023, model, 10));
+
+    // Join table with pairs of labels as keys (many different states)
+    mcm wide_model = create_model(2, 40, false);
+    dataset wide_data;
+    allocate_dataset(wide_data, 2000, 1);
+    for (int i = 0; i < 2000; ++i){
+        wide_data.states[i] = (__uint128_t) i * 2654435761u;
+    }
+    load_data(wide_model, wide_data);
+    __uint128_t component_1 = ((__uint128_t) 1 << 20) - 1;
+    __uint128_t component_2 = component_1 << 20;
+    init_labels(wide_model, component_1, labels_1);
+    init_labels(wide_model, component_2, labels_2);
+    EXPECT_GT((size_t) labels_1.n_labels * labels_2.n_labels, 4 * 2000 + 65536);
+    EXPECT_FLOAT_EQ(evidence_of_join(wide_model, labels_1, labels_2, &joined), calc_evidence_icc(component_1 | component_2, wide_model, 40));
+    EXPECT_EQ(joined.n_labels, 2000);
+}
+
+TEST(evidence, count_cache){
+    // Binary dataset where the first 24 variables only take 16 different values
+    mcm model = create_model(2, 40, false);
+    dataset data;
+    allocate_dataset(data, 2000, 1);
+    for (int i = 0; i < 2000; ++i){
+        data.states[i] = (i % 16) * 0x111111 + ((__uint128_t) ((i * 2654435761u) % 65536) << 24);
+    }
+    load_data(model, data);
+    model.exhaustive = false;
+    __uint128_t component = ((__uint128_t) 1 << 24) - 1;
+    __uint128_t subset = ((__uint128_t) 1 << 22) - 1;
+    ASSERT_TRUE(counted_with_table(model, 22));
+
+    // The table of the first component is kept
+    get_evidence_icc(component, model);
+    EXPECT_EQ(model.table_cache.tables.count(component), 1);
+
+    // Subsets are derived from the cached table
+    EXPECT_EQ(find_superset(model.table_cache, subset)->first, component);
+    EXPECT_EQ(find_superset(model.table_cache, (__uint128_t) 1 << 30), model.table_cache.tables.end());
+    EXPECT_FLOAT_EQ(get_evidence_icc(subset, model), calc_evidence_icc(subset, model, 22));
+
+    // The oldest tables are removed when the cache is full
+    model.table_cache.max_keys = model.table_cache.n_keys;
+    count_table counts;
+    count_observations(model, component << 1, counts);
+    add_to_cache(model.table_cache, component << 1, counts);
+    EXPECT_EQ(model.table_cache.tables.count(component), 0);
+    EXPECT_LE(model.table_cache.n_keys, model.table_cache.max_keys);
+    EXPECT_EQ(find_superset(model.table_cache, component << 1)->first, component << 1);
+
+    // The lists of the cached components that contain a variable only refer to components in the cache
+    size_t n_entries = 0;
+    size_t n_variables = 0;
+    for (int v = 0; v < 128; ++v){
+        for (__uint128_t cached : model.table_cache.containing[v]){
+            EXPECT_EQ(model.table_cache.tables.count(cached), 1);
+            EXPECT_TRUE((cached >> v) & 1);
+            ++n_entries;
+        }
+    }
+    for (const std::pair<const __uint128_t, count_table>& entry : model.table_cache.tables){
+        n_variables += component_size(entry.first);
+    }
+    EXPECT_EQ(n_entries, n_variables);
+}
+
+TEST(evidence, group_counts){
+    // Dataset with more states than a block, components counted with dense arrays and with tables
+    mcm model = create_model(2, 40, false);
+    dataset data;
+    allocate_dataset(data, 5000, 1);
+    for (int i = 0; i < 5000; ++i){
+        data.states[i] = ((__uint128_t) i * 2654435761u) ^ ((__uint128_t) i << 32);
+    }
+    load_data(model, data);
+    std::vector<__uint128_t> components = {0x3F, ((__uint128_t) 1 << 24) - 1, 0xFF00FF00FF, (__uint128_t) 0x3 << 30};
+    ASSERT_TRUE(use_dense_counts(model, 6));
+    ASSERT_TRUE(counted_with_table(model, 24));
+
+    std::vector<double> log_evidence;
+    std::vector<count_table> tables;
+    calc_evidence_group(model, components, log_evidence, tables);
+    for (size_t c = 0; c < components.size(); ++c){
+        int r = component_size(components[c]);
+        EXPECT_DOUBLE_EQ(log_evidence[c], calc_evidence_icc(components[c], model, r));
+        EXPECT_EQ(tables[c].occupied.empty(), !counted_with_table(model, r));
+    }
+}
+
+TEST(evidence, parallel_counts){
+    // Dataset with enough different states to count the shards in parallel
+    mcm model = create_model(2, 40, false);
+    dataset data;
+    allocate_dataset(data, 300000, 1);
+    for (int i = 0; i < 300000; ++i){
+        data.states[i] = ((__uint128_t) i * 2654435761u) & (((__uint128_t) 1 << 40) - 1);
+    }
+    load_data(model, data);
+    ASSERT_TRUE(use_parallel_counts(model));
+    __uint128_t component = ((__uint128_t) 1 << 36) - 1;
+    count_table counts;
+    count_observations(model, component, counts);
+
+    // The parts of the state space contain every state once
+    set_num_threads(4);
+    std::vector<count_table> parts;
+    count_observations_parallel(model, component, parts);
+    size_t n_keys = 0;
+    uint64_t total = 0;
+    for (count_table& part : parts){
+        n_keys += part.occupied.size();
+        for (unsigned int slot : part.occupied){
+            total += part.counts[slot];
+            EXPECT_EQ(part.counts[slot], table_count(counts, &part.keys[slot]));
+        }
+    }
+    EXPECT_EQ(n_keys, counts.occupied.size());
+    EXPECT_EQ(total, model.N);
+    EXPECT_NEAR(calc_evidence_icc(component, model, 36), evidence_from_table(counts, 36, model), 1e-6);
+
+    // Same result with one thread
+    double log_evidence = evidence_from_parts(parts, 36, model);
+    set_num_threads(1);
+    count_observations_parallel(model, component, parts);
+    EXPECT_EQ(evidence_from_parts(parts, 36, model), log_evidence);
+    set_num_threads(0);
+}
+
+TEST(evidence, precomputed_terms){
+    // Binary dataset with counts below and above the size of the histogram of small counts
+    mcm model = create_model(2, 4, false);
+    dataset data;
+    allocate_dataset(data, 16, 1);
+    for (int i = 0; i < 16; ++i){
+        data.states[i] = i;
+        data.weights[i] = 1 + i * i * 10;
+    }
+    load_data(model, data);
+    ASSERT_EQ(model.log_gamma.size(), model.N + 1);
+    EXPECT_DOUBLE_EQ(model.log_gamma[300], lgamma(300.5) - 0.5 * log(M_PI));
+    EXPECT_DOUBLE_EQ(evidence_prefactor(3, model), lgamma(4.) - lgamma(model.N + 4.));
+
+    // Same log evidence as summing the terms of all states
+    for (__uint128_t component : {(__uint128_t) 15, (__uint128_t) 5, (__uint128_t) 8}){
+        int r = component_size(component);
+        std::vector<uint64_t> counts(16, 0);
+        for (int i = 0; i < 16; ++i){
+            counts[i & (int) component] += data.weights[i];
+        }
+        double log_evidence = evidence_prefactor(r, model);
+        for (uint64_t count : counts){
+            if (count){
+                log_evidence += lgamma(count + 0.5) - 0.5 * log(M_PI);
+            }
+        }
+        EXPECT_NEAR(calc_evidence_icc(component, model, r), log_evidence, 1e-9);
+    }
+
+    // Without the precomputed terms, the terms are calculated
+    double log_evidence = calc_evidence_icc(15, model, 4);
+    model.log_gamma.clear();
+    model.prefactors.clear();
+    EXPECT_NEAR(calc_evidence_icc(15, model, 4), log_evidence, 1e-9);
+    EXPECT_DOUBLE_EQ(evidence_prefactor(3, model), lgamma(4.) - lgamma(model.N + 4.));
+}
+
+TEST(evidence, bit_sliced_counts){
+    // Binary dataset with many repeated states (weights up to 8) spread over several 64bit words
+    mcm model = create_model(2, 5, false);
+    dataset data;
+    allocate_dataset(data, 1000, 1);
+    for (int i = 0; i < 1000; ++i){
+        data.states[i] = (i * 7 + i / 13) % 32;
+    }
+    load_data(model, data);
+
+    double evidence[31];
+    for (__uint128_t component = 1; component < 32; ++component){
+        evidence[component-1] = calc_evidence_icc(component, model, component_size(component));
+    }
+
+    build_bit_slices(model.data, 5);
+    EXPECT_EQ(model.data.slices->n_words, 1);
+    EXPECT_TRUE(use_sliced_counts(model, 1));
+    EXPECT_FALSE(use_sliced_counts(model, 5));
+    EXPECT_FALSE(use_sliced_counts(model, 70));
+
+    // Counts of a single variable
+    std::vector<uint64_t> counts;
+    count_observations_sliced(*model.data.slices, 4, 1, counts);
+    EXPECT_EQ(counts[0] + counts[1], 1000);
+
+    // Same evidence with and without the bit-sliced view
+    for (__uint128_t component = 1; component < 32; ++component){
+        EXPECT_FLOAT_EQ(calc_evidence_icc(component, model, component_size(component)), evidence[component-1]) << "Wrong evidence for component " << (int) component;
+    }
+
+    // Without weight planes (no states) the view is never used
+    model.data.slices->n_weight_planes = 0;
+    EXPECT_FALSE(use_sliced_counts(model, 1));
+    EXPECT_FALSE(use_sliced_counts(model, 64));
+}
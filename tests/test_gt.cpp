@@ -22,63 +22,63 @@ TEST(gt, transform_state){
     expected_state = {0,0};
     conv_state = convert_representation(state, 2, 2);
     expected_conv_state = convert_representation(expected_state, 2, 2);
-    gt_state(conv_state, gt, 3, 2, 2);
+    gt_state(conv_state.data(), gt, 3, 2, 2);
     EXPECT_EQ(conv_state, expected_conv_state);
 
     state = {0,1};
     expected_state = {1,1};
     conv_state = convert_representation(state, 2, 2);
     expected_conv_state = convert_representation(expected_state, 2, 2);
-    gt_state(conv_state, gt, 3, 2, 2);
+    gt_state(conv_state.data(), gt, 3, 2, 2);
     EXPECT_EQ(conv_state, expected_conv_state);
 
     state = {0,2};
     expected_state = {2,2};
     conv_state = convert_representation(state, 2, 2);
     expected_conv_state = convert_representation(expected_state, 2, 2);
-    gt_state(conv_state, gt, 3, 2, 2);
+    gt_state(conv_state.data(), gt, 3, 2, 2);
     EXPECT_EQ(conv_state, expected_conv_state);
 
     state = {1,0};
     expected_state = {1,2};
     conv_state = convert_representation(state, 2, 2);
     expected_conv_state = convert_representation(expected_state, 2, 2);
-    gt_state(conv_state, gt, 3, 2, 2);
+    gt_state(conv_state.data(), gt, 3, 2, 2);
     EXPECT_EQ(conv_state, expected_conv_state);
 
     state = {1,1};
     expected_state = {2,0};
     conv_state = convert_representation(state, 2, 2);
     expected_conv_state = convert_representation(expected_state, 2, 2);
-    gt_state(conv_state, gt, 3, 2, 2);
+    gt_state(conv_state.data(), gt, 3, 2, 2);
     EXPECT_EQ(conv_state, expected_conv_state);
 
     state = {1,2};
     expected_state = {0,1};
     conv_state = convert_representation(state, 2, 2);
     expected_conv_state = convert_representation(expected_state, 2, 2);
-    gt_state(conv_state, gt, 3, 2, 2);
+    gt_state(conv_state.data(), gt, 3, 2, 2);
     EXPECT_EQ(conv_state, expected_conv_state);
 
     state = {2,0};
     expected_state = {2,1};
     conv_state = convert_representation(state, 2, 2);
     expected_conv_state = convert_representation(expected_state, 2, 2);
-    gt_state(conv_state, gt, 3, 2, 2);
+    gt_state(conv_state.data(), gt, 3, 2, 2);
     EXPECT_EQ(conv_state, expected_conv_state);
 
     state = {2,1};
     expected_state = {0,2};
     conv_state = convert_representation(state, 2, 2);
     expected_conv_state = convert_representation(expected_state, 2, 2);
-    gt_state(conv_state, gt, 3, 2, 2);
+    gt_state(conv_state.data(), gt, 3, 2, 2);
     EXPECT_EQ(conv_state, expected_conv_state);
 
     state = {2,2};
     expected_state = {1,0};
     conv_state = convert_representation(state, 2, 2);
     expected_conv_state = convert_representation(expected_state, 2, 2);
-    gt_state(conv_state, gt, 3, 2, 2);
+    gt_state(conv_state.data(), gt, 3, 2, 2);
     EXPECT_EQ(conv_state, expected_conv_state);
 }
 
@@ -97,17 +97,52 @@ TEST(gt, transform_data){
     std::vector<std::vector<int>> expected_transform = {{0,0}, {1,1}, {2,2},
                                 {1,2}, {2,0}, {0,1},
                                 {2,1}, {0,2}, {1,0}};
-    std::vector<std::vector<__uint128_t>> conv_data(9);
+    dataset conv_data;
+    allocate_dataset(conv_data, 9, 2);
     std::vector<std::vector<__uint128_t>> conv_transform(9);
     for (int i = 0; i < 9; ++i){
-        conv_data[i] = convert_representation(data[i], 2, 2);
+        std::vector<__uint128_t> obs = convert_representation(data[i], 2, 2);
+        std::copy(obs.begin(), obs.end(), conv_data.states + 2 * i);
         conv_transform[i] = convert_representation(expected_transform[i], 2, 2);
     }
 
     transform_data(conv_data, gt, 3, 2, 2);
 
     for (int i = 0; i < 9; ++i){
-        EXPECT_EQ(conv_data[i][0], conv_transform[i][0]);
-        EXPECT_EQ(conv_data[i][1], conv_transform[i][1]);
+        EXPECT_EQ(get_state(conv_data, i), conv_transform[i]);
+    }
+}
+
+TEST(gt, spectrum_binary){
+    // Binary dataset with 4 variables
+    mcm model = create_model(2, 4, false);
+    dataset data;
+    allocate_dataset(data, 100, 1);
+    for (int i = 0; i < 100; ++i){
+        data.states[i] = (i * 5) % 16;
+        data.weights[i] = 1 + i % 3;
+    }
+    load_data(model, data);
+
+    operator_spectrum spectrum;
+    build_spectrum(model, spectrum);
+    for (int i = 1; i < 16; ++i){
+        std::vector<int> a = {i & 1, (i >> 1) & 1, (i >> 2) & 1, (i >> 3) & 1};
+        std::vector<__uint128_t> op = convert_representation(a, 4, 1);
+        EXPECT_DOUBLE_EQ(entropy_from_spectrum(spectrum, a), entropy_of_op(model.data, op, 2, 1)) << "Wrong entropy for operator " << i;
+    }
+}
+
+TEST(gt, spectrum_q){
+    mcm model = create_model(3, 3, false);
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
+
+    operator_spectrum spectrum;
+    build_spectrum(model, spectrum);
+    for (int i = 1; i < 27; ++i){
+        std::vector<int> a = {i % 3, (i / 3) % 3, i / 9};
+        std::vector<__uint128_t> op = convert_representation(a, 3, model.n_ints);
+        EXPECT_DOUBLE_EQ(entropy_from_spectrum(spectrum, a), entropy_of_op(model.data, op, 3, model.n_ints)) << "Wrong entropy for operator " << i;
     }
 }
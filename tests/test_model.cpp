@@ -7,9 +7,8 @@ TEST(model, construction){
     // Construct model
     mcm model = create_model(q, n, false);
     // Read in data
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test.dat", n, model.n_ints);
-    model.data = data;
-    model.N = data.size();
+    dataset data = data_processing("../tests/test.dat", n, model.n_ints);
+    load_data(model, data);
 
     // Check initializations
     EXPECT_EQ(model.N, 7);
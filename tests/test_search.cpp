@@ -5,9 +5,8 @@
 TEST(search, greedy){
     // Read in test data + create model
     mcm model = create_model(3, 3, false);
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test.dat", 3, model.n_ints);
-    model.data = data;
-    model.N = data.size();
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
 
     greedy_search(model);
 
@@ -19,12 +18,73 @@ TEST(search, greedy){
     EXPECT_FLOAT_EQ(model.best_evidence, evidence);
 }
 
+TEST(search, greedy_heap){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+
+    greedy_search(model);
+
+    // Greedy merging that evaluates all pairs of components in every step
+    std::vector<__uint128_t> partition(model.n, 0);
+    for (int i = 0; i < model.n; i++){
+        partition[i] = (__uint128_t) 1 << i;
+    }
+    while (true){
+        int best_i, best_j;
+        double best_evidence_diff = 0;
+        for (int i = 0; i < model.n; i++){
+            if (partition[i] == 0){continue;}
+            for (int j = i+1; j < model.n; j++){
+                if (partition[j] == 0){continue;}
+                double evidence_diff = merge_difference(i, j, partition, model);
+                if (evidence_diff > best_evidence_diff){
+                    best_evidence_diff = evidence_diff;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+        if (best_evidence_diff == 0){break;}
+        partition[best_i] += partition[best_j];
+        partition[best_j] = 0;
+    }
+
+    EXPECT_EQ(model.best_mcm[0], partition);
+    EXPECT_FLOAT_EQ(model.best_evidence, calc_evidence(partition, model));
+}
+
+TEST(search, batch_greedy){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+
+    batch_greedy_search(model);
+
+    // Every variable is in exactly one component
+    __uint128_t variables = 0;
+    for (__uint128_t component : model.best_mcm[0]){
+        EXPECT_EQ(variables & component, 0);
+        variables |= component;
+    }
+    EXPECT_EQ(variables, 1023);
+    EXPECT_FLOAT_EQ(model.best_evidence, calc_evidence(model.best_mcm[0], model));
+
+    // No merge of two components increases the evidence
+    std::vector<__uint128_t>& partition = model.best_mcm[0];
+    for (int i = 0; i < model.n; i++){
+        for (int j = i+1; j < model.n; j++){
+            if (partition[i] == 0 || partition[j] == 0){continue;}
+            EXPECT_LE(merge_difference(i, j, partition, model), 0);
+        }
+    }
+}
+
 TEST(search, divide_and_conquer){
     // Read in test data + create model
     mcm model = create_model(3, 3, false);
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test.dat", 3, model.n_ints);
-    model.data = data;
-    model.N = data.size();
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
 
     divide_and_conquer(model);
 
@@ -36,12 +96,32 @@ TEST(search, divide_and_conquer){
     EXPECT_FLOAT_EQ(model.best_evidence, evidence);
 }
 
+TEST(search, divide_and_conquer_parallel){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+
+    // Sequential recursion
+    set_num_threads(1);
+    divide_and_conquer(model);
+    std::vector<__uint128_t> sequential_mcm = model.best_mcm[0];
+    double sequential_evidence = model.best_evidence;
+
+    // Parts split in parallel -> same components at the same indices
+    model.best_mcm.clear();
+    set_num_threads(4);
+    divide_and_conquer(model);
+    set_num_threads(0);
+
+    EXPECT_EQ(model.best_mcm[0], sequential_mcm);
+    EXPECT_EQ(model.best_evidence, sequential_evidence);
+}
+
 TEST(search, exhaustive){
     // Read in test data + create model
     mcm model = create_model(3, 3, false);
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test.dat", 3, model.n_ints);
-    model.data = data;
-    model.N = data.size();
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
 
     exhaustive_search(model);
 
@@ -56,9 +136,8 @@ TEST(search, exhaustive){
 TEST(search, n_solutions){
     // Read in test data + create model
     mcm model = create_model(3, 10, false);
-    std::vector<std::vector<__uint128_t>> data = data_processing("../tests/test_2.dat", 10, model.n_ints);
-    model.data = data;
-    model.N = data.size();
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
     exhaustive_search(model);
 
     // Expected results
@@ -70,3 +149,307 @@ TEST(search, n_solutions){
     EXPECT_EQ(model.best_mcm[0], mcm);
     EXPECT_FLOAT_EQ(model.best_evidence, evidence);
 }
+
+TEST(search, partition_prefix){
+    // Number of partitions of 6 variables (Bell number) for every number of fixed values
+    int n = 6;
+    for (int k = 1; k <= n; ++k){
+        int n_partitions = 0;
+        int prefix[k];
+        int b_prefix[k];
+        std::fill(prefix, prefix + k, 0);
+        std::fill(b_prefix, b_prefix + k, 1);
+        do{
+            // Partitions that start with the prefix
+            int a[n];
+            int b[n];
+            int max_value = 0;
+            b[0] = 1;
+            for (int i = 0; i < n; ++i){
+                a[i] = (i < k) ? prefix[i] : 0;
+                if (i > 0){b[i] = max_value + 1;}
+                max_value = std::max(max_value, a[i]);
+            }
+            do{++n_partitions;} while (generate_next_partition(a, b, n, k));
+        } while (generate_next_partition(prefix, b_prefix, k));
+        EXPECT_EQ(n_partitions, 203) << "Wrong number of partitions for " << k << " fixed values";
+    }
+}
+
+TEST(search, exhaustive_parallel){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+
+    // Same results in the same order for any number of threads
+    set_num_threads(1);
+    exhaustive_search(model);
+    std::vector<std::vector<__uint128_t>> expected_mcms = model.best_mcm;
+    double expected_evidence = model.best_evidence;
+
+    set_num_threads(4);
+    exhaustive_search(model);
+    set_num_threads(0);
+
+    EXPECT_EQ(model.best_mcm, expected_mcms);
+    EXPECT_DOUBLE_EQ(model.best_evidence, expected_evidence);
+}
+
+TEST(search, subset_dp){
+    // Read in test data + create model
+    mcm model = create_model(3, 3, false);
+    dataset data = data_processing("../tests/test.dat", 3, model.n_ints);
+    load_data(model, data);
+
+    subset_dp_search(model);
+
+    // Expected results
+    std::vector<__uint128_t> mcm = {7,0,0};
+    double evidence = -23.324842793537613;
+
+    EXPECT_EQ(model.best_mcm.size(), 1);
+    EXPECT_EQ(model.best_mcm[0], mcm);
+    EXPECT_FLOAT_EQ(model.best_evidence, evidence);
+}
+
+TEST(search, subset_dp_n_solutions){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+
+    // All tied optima in the same order as the exhaustive search
+    exhaustive_search(model);
+    std::vector<std::vector<__uint128_t>> expected_mcms = model.best_mcm;
+    double expected_evidence = model.best_evidence;
+
+    subset_dp_search(model);
+
+    EXPECT_EQ(model.best_mcm, expected_mcms);
+    EXPECT_FLOAT_EQ(model.best_evidence, expected_evidence);
+}
+
+TEST(search, gray_enumeration){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+    model.histogram.width = 0.5;
+    model.top_mcm.k = 20;
+    exhaustive_search(model);
+
+    // Evidence of all partitions in lexicographic order
+    std::vector<double> expected;
+    evidence_histogram expected_histogram;
+    expected_histogram.width = 0.5;
+    int a[10];
+    int b[10];
+    std::fill(a, a + 10, 0);
+    std::fill(b, b + 10, 1);
+    std::vector<__uint128_t> partition(10, 0);
+    do{
+        std::fill(partition.begin(), partition.end(), 0);
+        convert_partition(a, partition, 10);
+        expected.push_back(calc_evidence(partition, model));
+        add_to_histogram(expected_histogram, expected.back());
+    } while (generate_next_partition(a, b, 10));
+
+    // Every partition is visited once (Bell(10) partitions) with the correct running evidence
+    uint64_t n_partitions = 0;
+    for (uint64_t count : model.histogram.counts){
+        n_partitions += count;
+    }
+    EXPECT_EQ(n_partitions, 115975);
+    EXPECT_EQ(model.histogram.first_bin, expected_histogram.first_bin);
+    EXPECT_EQ(model.histogram.counts, expected_histogram.counts);
+
+    // Best 20 partitions with their exact evidence
+    std::sort(expected.begin(), expected.end(), std::greater<double>());
+    std::vector<std::pair<double, std::vector<__uint128_t>>> top = sorted_top(model.top_mcm);
+    ASSERT_EQ(top.size(), 20);
+    for (int i = 0; i < 20; ++i){
+        EXPECT_DOUBLE_EQ(top[i].first, expected[i]);
+        EXPECT_DOUBLE_EQ(calc_evidence(top[i].second, model), top[i].first);
+    }
+}
+
+TEST(search, exhaustive_large_n){
+    // Every state observed 10^6 times -> log evidence of the order of 1E9 and many partitions with the same evidence
+    mcm model = create_model(2, 10, false);
+    dataset data;
+    allocate_dataset(data, 1024, model.n_ints);
+    for (int i = 0; i < 1024; ++i){
+        data.states[i] = i;
+        data.weights[i] = 1000000 + (i * 7919) % 4096;
+    }
+    ASSERT_TRUE(load_data(model, data));
+    model.top_mcm.k = 20;
+    exhaustive_search(model);
+
+    // Exact evidence of all partitions in lexicographic order
+    std::vector<std::pair<double, std::vector<__uint128_t>>> expected;
+    std::vector<int> a(10, 0);
+    std::vector<int> b(10, 1);
+    do{
+        std::vector<__uint128_t> partition(10, 0);
+        convert_partition(a.data(), partition, 10);
+        expected.push_back(std::make_pair(calc_evidence(partition, model), partition));
+    } while (generate_next_partition(a.data(), b.data(), 10));
+    std::sort(expected.begin(), expected.end(), std::greater<std::pair<double, std::vector<__uint128_t>>>());
+    EXPECT_LT(expected[0].first, -1E8);
+
+    // Same best partitions as the enumeration
+    EXPECT_EQ(model.best_evidence, expected[0].first);
+    std::vector<std::vector<__uint128_t>> expected_mcms;
+    for (size_t i = 0; i < expected.size() && expected[i].first > expected[0].first - evidence_tolerance; ++i){
+        expected_mcms.push_back(expected[i].second);
+    }
+    std::vector<std::vector<__uint128_t>> best_mcms = model.best_mcm;
+    std::sort(best_mcms.begin(), best_mcms.end());
+    std::sort(expected_mcms.begin(), expected_mcms.end());
+    EXPECT_EQ(best_mcms, expected_mcms);
+
+    // Same best 20 evidences
+    std::vector<std::pair<double, std::vector<__uint128_t>>> top = sorted_top(model.top_mcm);
+    ASSERT_EQ(top.size(), 20);
+    for (size_t i = 0; i < top.size(); ++i){
+        EXPECT_EQ(top[i].first, expected[i].first);
+    }
+}
+
+TEST(search, histogram_top){
+    evidence_histogram histogram;
+    histogram.width = 2;
+    add_to_histogram(histogram, -3);
+    add_to_histogram(histogram, -0.5);
+    add_to_histogram(histogram, -7);
+    add_to_histogram(histogram, 1);
+    EXPECT_EQ(histogram.first_bin, -4);
+    std::vector<uint64_t> counts = {1,0,1,1,1};
+    EXPECT_EQ(histogram.counts, counts);
+
+    evidence_histogram other;
+    other.width = 2;
+    add_to_histogram(other, 5);
+    merge_histograms(histogram, other);
+    counts = {1,0,1,1,1,0,1};
+    EXPECT_EQ(histogram.counts, counts);
+
+    // Only the 2 best partitions are kept, ties are ordered by the components
+    top_partitions top;
+    top.k = 2;
+    add_to_top(top, -5, {3,0});
+    add_to_top(top, -2, {2,1});
+    add_to_top(top, -8, {1,2});
+    add_to_top(top, -2, {1,2});
+    std::vector<std::pair<double, std::vector<__uint128_t>>> sorted = sorted_top(top);
+    ASSERT_EQ(sorted.size(), 2);
+    EXPECT_EQ(sorted[0].second, std::vector<__uint128_t>({1,2}));
+    EXPECT_EQ(sorted[1].second, std::vector<__uint128_t>({2,1}));
+    EXPECT_FALSE(enters_top(top, -3));
+}
+
+TEST(search, checkpoint){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+    model.top_mcm.k = 5;
+    exhaustive_search(model);
+    std::vector<std::vector<__uint128_t>> expected_mcms = model.best_mcm;
+    std::vector<std::pair<double, std::vector<__uint128_t>>> expected_top = sorted_top(model.top_mcm);
+
+    // Checkpoint of a search where only the even units are done
+    model.checkpoint_file = "checkpoint.mcmc";
+    exhaustive_search(model);
+    search_progress progress;
+    ASSERT_TRUE(read_checkpoint("checkpoint.mcmc", model, progress));
+    search_progress partial;
+    partial.k = progress.k;
+    partial.done.assign(progress.done.size(), 0);
+    partial.result.top_mcm.k = 5;
+    for (size_t unit = 0; unit < partial.done.size(); unit += 2){
+        partial.done[unit] = 1;
+    }
+    ASSERT_TRUE(write_checkpoint("checkpoint.mcmc", model, partial));
+
+    // Resuming only processes the remaining units, which gives the partitions of the odd units
+    model.resume = true;
+    exhaustive_search(model);
+    EXPECT_LT(model.best_mcm.size(), expected_mcms.size());
+
+    // Resuming a complete checkpoint gives the full result
+    ASSERT_TRUE(write_checkpoint("checkpoint.mcmc", model, progress));
+    exhaustive_search(model);
+    EXPECT_EQ(model.best_mcm, expected_mcms);
+    std::vector<std::pair<double, std::vector<__uint128_t>>> top = sorted_top(model.top_mcm);
+    EXPECT_EQ(top, expected_top);
+
+    // A checkpoint with other options for the list of the best partitions is not resumed
+    model.top_mcm.k = 3;
+    EXPECT_FALSE(read_checkpoint("checkpoint.mcmc", model, progress));
+
+    // Numbers of entries that do not fit in the file
+    checkpoint_header header;
+    std::fstream file("checkpoint.mcmc", std::ios::in | std::ios::out | std::ios::binary);
+    uint64_t n_entries = (uint64_t) 1 << 60;
+    file.seekp(sizeof(checkpoint_header) + progress.done.size() + sizeof(double));
+    file.write((const char*) &n_entries, sizeof(n_entries));
+    file.close();
+    EXPECT_FALSE(read_checkpoint_file("checkpoint.mcmc", header, progress));
+    file.open("checkpoint.mcmc", std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(sizeof(checkpoint_header) - sizeof(uint64_t));
+    file.write((const char*) &n_entries, sizeof(n_entries));
+    file.close();
+    EXPECT_FALSE(read_checkpoint_file("checkpoint.mcmc", header, progress));
+
+    // Number of units that does not match the length of the prefixes
+    ASSERT_TRUE(write_checkpoint("checkpoint.mcmc", model, progress));
+    ASSERT_TRUE(read_checkpoint_file("checkpoint.mcmc", header, progress));
+    n_entries = progress.done.size() - 1;
+    file.open("checkpoint.mcmc", std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(sizeof(checkpoint_header) - sizeof(uint64_t));
+    file.write((const char*) &n_entries, sizeof(n_entries));
+    file.close();
+    EXPECT_FALSE(read_checkpoint_file("checkpoint.mcmc", header, progress));
+    std::remove("checkpoint.mcmc");
+}
+
+TEST(search, shards){
+    mcm model = create_model(3, 10, false);
+    dataset data = data_processing("../tests/test_2.dat", 10, model.n_ints);
+    load_data(model, data);
+    model.histogram.width = 1;
+    exhaustive_search(model);
+    std::vector<std::vector<__uint128_t>> expected_mcms = model.best_mcm;
+    std::vector<uint64_t> expected_counts = model.histogram.counts;
+
+    // Every shard writes its results to a file
+    model.n_shards = 3;
+    for (int shard = 0; shard < 3; ++shard){
+        model.shard = shard;
+        model.checkpoint_file = "shard_" + std::to_string(shard) + ".mcmc";
+        exhaustive_search(model);
+    }
+
+    // Combine the shards
+    checkpoint_header header;
+    search_progress merged;
+    ASSERT_TRUE(read_checkpoint_file("shard_0.mcmc", header, merged));
+    EXPECT_EQ(header.n_shards, 3);
+    for (int shard = 1; shard < 3; ++shard){
+        checkpoint_header shard_header;
+        search_progress progress;
+        ASSERT_TRUE(read_checkpoint_file("shard_" + std::to_string(shard) + ".mcmc", shard_header, progress));
+        EXPECT_EQ(progress.k, merged.k);
+        for (size_t unit = 0; unit < merged.done.size(); ++unit){
+            EXPECT_FALSE(merged.done[unit] && progress.done[unit]) << "Unit " << unit << " is in two shards";
+            merged.done[unit] |= progress.done[unit];
+        }
+        merge_unit_result(merged.result, progress.result);
+        std::remove(("shard_" + std::to_string(shard) + ".mcmc").c_str());
+    }
+    std::remove("shard_0.mcmc");
+
+    EXPECT_EQ(std::count(merged.done.begin(), merged.done.end(), 1), merged.done.size());
+    std::sort(merged.result.best_mcm.begin(), merged.result.best_mcm.end(), comp_rgs);
+    EXPECT_EQ(merged.result.best_mcm, expected_mcms);
+    EXPECT_EQ(merged.result.histogram.counts, expected_counts);
+}
@@ -61,35 +61,35 @@ TEST(spin_op, spin_value){
 
     op = {0,0};
     conv_op = convert_representation(op, 2, 1);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 2, 1), 0);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 2, 1), 0);
 
     state = {0,1};
     conv_state = convert_representation(state, 2, 1);
 
     op = {1,0};
     conv_op = convert_representation(op, 2, 1);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 2, 1), 0);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 2, 1), 0);
     op = {0,1};
     conv_op = convert_representation(op, 2, 1);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 2, 1), 1);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 2, 1), 1);
     op = {1,1};
     conv_op = convert_representation(op, 2, 1);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 2, 1), 1);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 2, 1), 1);
 
     state = {1,0};
     conv_state = convert_representation(state, 2, 1);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 2, 1), 1);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 2, 1), 1);
 
     state = {1,1};
     conv_state = convert_representation(state, 2, 1);
 
     op = {1,0};
     conv_op = convert_representation(op, 2, 1);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 2, 1), 1);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 2, 1), 1);
 
     op = {1,1};
     conv_op = convert_representation(op, 2, 1);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 2, 1), 0);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 2, 1), 0);
 
     // Base 3
     state = {1,0};
@@ -97,23 +97,23 @@ TEST(spin_op, spin_value){
 
     op = {1,0};
     conv_op = convert_representation(op, 2, 2);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 3, 2), 1);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 3, 2), 1);
 
     state = {2,0};
     conv_state = convert_representation(state, 2, 2);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 3, 2), 2);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 3, 2), 2);
 
     op = {1,1};
     conv_op = convert_representation(op, 2, 2);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 3, 2), 2);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 3, 2), 2);
 
     state = {2,1};
     conv_state = convert_representation(state, 2, 2);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 3, 2), 0);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 3, 2), 0);
 
     op = {1,2};
     conv_op = convert_representation(op, 2, 2);
-    EXPECT_EQ(spin_value(conv_state, conv_op, 3, 2), 1);
+    EXPECT_EQ(spin_value(conv_state.data(), conv_op.data(), 3, 2), 1);
 }
 
 TEST(spin_op, entropy){
@@ -139,9 +139,11 @@ TEST(spin_op, entropy_op){
                                 {0,1,1,1},
                                 {0,2,0,0}};
     
-    std::vector<std::vector<__uint128_t>> conv_data;
-    for(std::vector<int>& obs : data){
-        conv_data.push_back(convert_representation(obs, 4, 2));
+    dataset conv_data;
+    allocate_dataset(conv_data, 4, 2);
+    for(int i = 0; i < 4; i++){
+        std::vector<__uint128_t> obs = convert_representation(data[i], 4, 2);
+        std::copy(obs.begin(), obs.end(), conv_data.states + 2 * i);
     }
 
     op = {0,0,0,0};
@@ -172,3 +174,49 @@ TEST(spin_op, entropy_op){
     conv_op = convert_representation(op, 4, 2);
     EXPECT_FLOAT_EQ(entropy_of_op(conv_data, conv_op, 3, 2), 0.8112781244591);
 }
+
+TEST(spin_op, entropy_op_weighted){
+    std::vector<int> op;
+    std::vector<__uint128_t> conv_op;
+
+    // Same distribution as four observations {0,1,0,0}, {0,1,2,2}, {0,1,1,1}, {0,2,0,0} stored as two different states with weights 3 and 1
+    std::vector<std::vector<int>> data = {{0,1,0,0},
+                                {0,2,0,0}};
+    dataset conv_data;
+    allocate_dataset(conv_data, 2, 2);
+    for(int i = 0; i < 2; i++){
+        std::vector<__uint128_t> obs = convert_representation(data[i], 4, 2);
+        std::copy(obs.begin(), obs.end(), conv_data.states + 2 * i);
+    }
+    conv_data.weights[0] = 3;
+
+    op = {1,0,0,0};
+    conv_op = convert_representation(op, 4, 2);
+    EXPECT_EQ(entropy_of_op(conv_data, conv_op, 3, 2), 0);
+
+    op = {0,1,0,0};
+    conv_op = convert_representation(op, 4, 2);
+    EXPECT_FLOAT_EQ(entropy_of_op(conv_data, conv_op, 3, 2), 0.8112781244591);
+}
+
+TEST(spin_op, entropy_op_bit_sliced){
+    // Binary dataset with 100 states (two 64bit words in the bit-sliced view)
+    dataset data;
+    allocate_dataset(data, 100, 1);
+    for (int i = 0; i < 100; ++i){
+        data.states[i] = (i * 5) % 16;
+        data.weights[i] = 1 + i % 3;
+    }
+    std::vector<double> expected(16);
+    std::vector<__uint128_t> op(1);
+    for (int i = 0; i < 16; ++i){
+        op[0] = i;
+        expected[i] = entropy_of_op(data, op, 2, 1);
+    }
+
+    build_bit_slices(data, 4);
+    for (int i = 0; i < 16; ++i){
+        op[0] = i;
+        EXPECT_DOUBLE_EQ(entropy_of_op(data, op, 2, 1), expected[i]) << "Wrong entropy for operator " << i;
+    }
+}